@@ -0,0 +1,82 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/**
+ * Replaces the global allocation functions so that the benchmarks in the
+ * examples can report allocations and bytes per operation. Every form of
+ * operator new and delete is replaced together, so they always match.
+ *
+ * The replacements are ordinary (non-inline) definitions, as the standard
+ * requires: include this header from exactly one translation unit of a
+ * program.
+ */
+inline std::atomic<size_t> allocation_count{0};
+inline std::atomic<size_t> allocated_bytes{0};
+
+namespace allocation_counter {
+
+// Kept out of line: if GCC inlines these into callers it mistakes the
+// malloc/free pairing for a new/free mismatch and warns.
+[[gnu::noinline]] inline void* Allocate(size_t size, size_t alignment) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  size = size ? size : 1;
+  void* memory = alignment <= alignof(std::max_align_t)
+                     ? std::malloc(size)
+                     : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+[[gnu::noinline]] inline void Release(void* memory) noexcept {
+  std::free(memory);
+}
+
+}  // namespace allocation_counter
+
+void* operator new(size_t size) {
+  return allocation_counter::Allocate(size, alignof(std::max_align_t));
+}
+void* operator new[](size_t size) {
+  return allocation_counter::Allocate(size, alignof(std::max_align_t));
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+  return allocation_counter::Allocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return allocation_counter::Allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept {
+  allocation_counter::Release(memory);
+}
+void operator delete[](void* memory) noexcept {
+  allocation_counter::Release(memory);
+}
+void operator delete(void* memory, size_t) noexcept {
+  allocation_counter::Release(memory);
+}
+void operator delete[](void* memory, size_t) noexcept {
+  allocation_counter::Release(memory);
+}
+void operator delete(void* memory, std::align_val_t) noexcept {
+  allocation_counter::Release(memory);
+}
+void operator delete[](void* memory, std::align_val_t) noexcept {
+  allocation_counter::Release(memory);
+}
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+  allocation_counter::Release(memory);
+}
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+  allocation_counter::Release(memory);
+}
+
+#endif  // ALLOCATION_COUNTER_H
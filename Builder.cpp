@@ -7,6 +7,18 @@
  * builders may not always follow the same interface.
  */
 
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AllocationCounter.h"
+
 class Product1{
     public:
     std::vector<std::string> parts_;
@@ -102,9 +114,6 @@ class ConcreteBuilder1 : public Builder{
      * memory. Here could be a better option to use smart pointers to avoid
      * memory leaks
      */
-
-
-Translated with www.DeepL.com/Translator (free version)
     Product1* GetProduct() {
         Product1* result= this->product;
         this->Reset();
@@ -132,6 +141,13 @@ class Director{
 
     public:
 
+    /**
+     * How many construction steps each recipe performs, so builders can size
+     * their products up front.
+     */
+    static constexpr size_t kMinimalViableSteps = 1;
+    static constexpr size_t kFullFeaturedSteps = 3;
+
     void set_builder(Builder* builder){
         this->builder=builder;
     }
@@ -152,6 +168,220 @@ class Director{
     }
 };
 
+/**
+ * A product for high-volume building. Its parts are views of string literals
+ * (the part names are fixed), so adding a part never allocates a string.
+ */
+class LeanProduct{
+    public:
+    std::vector<std::string_view> parts_;
+    void ListParts()const{
+        std::cout << "Product parts: ";
+        for (size_t i=0;i<parts_.size();i++){
+            std::cout << parts_[i] << (i + 1 < parts_.size() ? ", " : "");
+        }
+        std::cout << "\n\n";
+    }
+};
+
+/**
+ * Keeps finished products for reuse. A product handed out by the pool comes
+ * back to it automatically when its handle is destroyed; its parts are
+ * cleared but the vector keeps its capacity, so a steady build loop stops
+ * allocating after warm-up.
+ */
+class ProductPool{
+    public:
+    struct Recycler{
+        ProductPool* pool;
+        void operator()(LeanProduct* product) const{
+            pool->Release(product);
+        }
+    };
+    using Handle = std::unique_ptr<LeanProduct, Recycler>;
+
+    ProductPool() = default;
+    ProductPool(const ProductPool&) = delete;
+    ProductPool& operator=(const ProductPool&) = delete;
+
+    Handle Acquire(size_t parts_capacity){
+        std::unique_ptr<LeanProduct> product;
+        if(free_.empty()){
+            product = std::make_unique<LeanProduct>();
+        }else{
+            product = std::move(free_.back());
+            free_.pop_back();
+        }
+        product->parts_.reserve(parts_capacity);
+        return Handle(product.release(), Recycler{this});
+    }
+
+    size_t available() const{
+        return free_.size();
+    }
+
+    private:
+    void Release(LeanProduct* product){
+        product->parts_.clear();
+        free_.emplace_back(product);
+    }
+
+    std::vector<std::unique_ptr<LeanProduct>> free_;
+};
+
+/**
+ * A builder that draws its products from a pool and hands them out as
+ * move-only handles, so ownership is explicit and nothing has to be deleted
+ * by hand. The pool must outlive every handle it produced.
+ */
+class PooledBuilder : public Builder{
+    private:
+
+    ProductPool& pool_;
+    size_t expected_steps_;
+    ProductPool::Handle product;
+
+    public:
+
+    PooledBuilder(ProductPool& pool, size_t expected_steps = Director::kFullFeaturedSteps)
+        : pool_(pool), expected_steps_(expected_steps), product(nullptr, ProductPool::Recycler{&pool}){
+        this->Reset();
+    }
+
+    void Reset(){
+        this->product = pool_.Acquire(expected_steps_);
+    }
+
+    void ProducePartA()const override{
+        this->product->parts_.push_back("PartA1");
+    }
+
+    void ProducePartB()const override{
+        this->product->parts_.push_back("PartB1");
+    }
+
+    void ProducePartC()const override{
+        this->product->parts_.push_back("PartC1");
+    }
+
+    ProductPool::Handle GetProduct(){
+        ProductPool::Handle result = std::move(this->product);
+        this->Reset();
+        return result;
+    }
+};
+
+/**
+ * When the recipes are known at compile time the whole pipeline can be
+ * resolved statically. Construction steps become tag types, a recipe is a
+ * list of steps, and a builder is a CRTP base plus one Produce overload per
+ * step. No virtual call is left, and the product is an std::array whose
+ * length is the recipe's step count.
+ */
+struct PartA{};
+struct PartB{};
+struct PartC{};
+
+template <typename... Steps>
+struct Recipe{
+    static constexpr size_t kStepCount = sizeof...(Steps);
+};
+
+using MinimalViableRecipe = Recipe<PartA>;
+using FullFeaturedRecipe = Recipe<PartA, PartB, PartC>;
+
+template <size_t N>
+struct StaticProduct{
+    std::array<std::string_view, N> parts_;
+    void ListParts()const{
+        std::cout << "Product parts: ";
+        for (size_t i=0;i<N;i++){
+            std::cout << parts_[i] << (i + 1 < N ? ", " : "");
+        }
+        std::cout << "\n\n";
+    }
+};
+
+template <typename Derived>
+class StaticBuilder{
+    public:
+
+    template <typename... Steps>
+    static constexpr StaticProduct<sizeof...(Steps)> Build(Recipe<Steps...>){
+        return {{Derived::Produce(Steps{})...}};
+    }
+
+    /**
+     * The total length of all part names of a recipe, e.g. to size an output
+     * buffer once.
+     */
+    template <typename... Steps>
+    static constexpr size_t TextSize(Recipe<Steps...>){
+        return (size_t{0} + ... + Derived::Produce(Steps{}).size());
+    }
+};
+
+class StaticBuilder1 : public StaticBuilder<StaticBuilder1>{
+    public:
+    static constexpr std::string_view Produce(PartA){ return "PartA1"; }
+    static constexpr std::string_view Produce(PartB){ return "PartB1"; }
+    static constexpr std::string_view Produce(PartC){ return "PartC1"; }
+};
+
+/**
+ * The static counterpart of Director: the builder is a template parameter
+ * and each recipe is a type.
+ */
+template <typename ConcreteBuilder>
+class StaticDirector{
+    public:
+    static constexpr auto BuildMinimalViableProduct(){
+        return ConcreteBuilder::Build(MinimalViableRecipe{});
+    }
+    static constexpr auto BuildFullFeaturedProduct(){
+        return ConcreteBuilder::Build(FullFeaturedRecipe{});
+    }
+};
+
+static_assert(FullFeaturedRecipe::kStepCount == Director::kFullFeaturedSteps);
+static_assert(StaticBuilder1::TextSize(FullFeaturedRecipe{}) == 18);
+static_assert(StaticDirector<StaticBuilder1>::BuildFullFeaturedProduct().parts_[2] == "PartC1");
+
+void BenchmarkBuilders(){
+    constexpr size_t kProducts = 1000000;
+    Director director;
+    size_t parts = 0;
+
+    ConcreteBuilder1 classic;
+    director.set_builder(&classic);
+    size_t allocations = allocation_count;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<kProducts;i++){
+        director.BuildFullFeaturedProduct();
+        Product1* p = classic.GetProduct();
+        parts += p->parts_.size();
+        delete p;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "ConcreteBuilder1: " << static_cast<double>(allocation_count - allocations) / kProducts
+              << " allocations/product, " << elapsed / kProducts << " ns/product\n";
+
+    ProductPool pool;
+    PooledBuilder pooled(pool, Director::kFullFeaturedSteps);
+    director.set_builder(&pooled);
+    allocations = allocation_count;
+    start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<kProducts;i++){
+        director.BuildFullFeaturedProduct();
+        ProductPool::Handle p = pooled.GetProduct();
+        parts += p->parts_.size();
+    }
+    elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "PooledBuilder:    " << static_cast<double>(allocation_count - allocations) / kProducts
+              << " allocations/product, " << elapsed / kProducts << " ns/product"
+              << (parts == 2 * kProducts * Director::kFullFeaturedSteps ? "" : " (part count mismatch)") << "\n";
+}
+
 /**
  * Client code creates a builder object, passes it to the director, and then
  * initiates the building process. The final result is retrieved from the object-
@@ -190,9 +420,58 @@ void ClientCode(Director& director)
     delete builder;
 }
 
+/**
+ * Forces `value` to be materialized in memory, so a benchmark loop cannot
+ * fold away the work that produced it.
+ */
+template <typename T>
+void DoNotOptimize(const T& value){
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Compares the virtual Director path with the statically dispatched one.
+ * The static recipe is resolved at compile time, so what is left to measure
+ * is writing the finished product out; DoNotOptimize keeps that in the loop.
+ */
+void BenchmarkStaticDirector(){
+    constexpr size_t kProducts = 1000000;
+    Director director;
+    ConcreteBuilder1 classic;
+    director.set_builder(&classic);
+    size_t parts = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<kProducts;i++){
+        director.BuildFullFeaturedProduct();
+        Product1* p = classic.GetProduct();
+        parts += p->parts_.size();
+        delete p;
+    }
+    const auto virtual_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<kProducts;i++){
+        auto product = StaticDirector<StaticBuilder1>::BuildFullFeaturedProduct();
+        DoNotOptimize(product);
+        parts += product.parts_.size();
+    }
+    const auto static_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "virtual Director: " << static_cast<double>(virtual_ns) / kProducts << " ns/product, StaticDirector: "
+              << static_cast<double>(static_ns) / kProducts << " ns/product"
+              << (parts == 2 * kProducts * FullFeaturedRecipe::kStepCount ? "" : " (part count mismatch)") << "\n";
+}
+
 int main(){
     Director* director= new Director();
     ClientCode(*director);
     delete director;
+
+    BenchmarkBuilders();
+
+    std::cout << "Static full featured product:\n";
+    StaticDirector<StaticBuilder1>::BuildFullFeaturedProduct().ListParts();
+    BenchmarkStaticDirector();
     return 0;    
 }
\ No newline at end of file
@@ -1,3 +1,40 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AllocationCounter.h"
+
+/**
+ * Collects the text of an operation. Layers append to it in order instead of
+ * building and concatenating their own strings, and Clear() keeps the
+ * capacity, so a reused buffer stops allocating after the first operation.
+ */
+class OutputBuffer {
+ public:
+  explicit OutputBuffer(size_t capacity = 0) {
+    text_.reserve(capacity);
+  }
+  void Append(std::string_view text) {
+    text_.append(text);
+  }
+  void Clear() {
+    text_.clear();
+  }
+  std::string_view view() const {
+    return text_;
+  }
+  size_t size() const {
+    return text_.size();
+  }
+
+ private:
+  std::string text_;
+};
+
 /**
  * The base interface of the Component defines the behavior that is modified
  * decorators.
@@ -6,6 +43,13 @@ class Component {
  public:
   virtual ~Component() {}
   virtual std::string Operation() const = 0;
+  /**
+   * Appends the result to `out`. Components that do not override it pay for
+   * the string Operation once.
+   */
+  virtual void Operation(OutputBuffer& out) const {
+    out.Append(this->Operation());
+  }
 };
 /**
  * Specific Components provide default behavior implementations. There may be
@@ -16,6 +60,9 @@ class ConcreteComponent : public Component {
   std::string Operation() const override {
     return "ConcreteComponent";
   }
+  void Operation(OutputBuffer& out) const override {
+    out.Append("ConcreteComponent");
+  }
 };
 
 /**
@@ -39,6 +86,8 @@ class Decorator : public Component
   /**
    * The decorator delegates all work to the wrapped component.
    */
+  using Component::Operation;
+
   std::string Operation() const override {
     return this->component_->Operation();
   }
@@ -61,6 +110,11 @@ class ConcreteDecoratorA : public Decorator
   std::string Operation() const override {
     return "ConcreteDecoratorA(" + Decorator::Operation() + ")";
   }
+  void Operation(OutputBuffer& out) const override {
+    out.Append("ConcreteDecoratorA(");
+    this->component_->Operation(out);
+    out.Append(")");
+  }
 };
 /**
  * Decorators can perform their behavior before or after calling the wrapped
@@ -74,8 +128,124 @@ class ConcreteDecoratorB : public Decorator {
   std::string Operation() const override {
     return "ConcreteDecoratorB(" + Decorator::Operation() + ")";
   }
+  void Operation(OutputBuffer& out) const override {
+    out.Append("ConcreteDecoratorB(");
+    this->component_->Operation(out);
+    out.Append(")");
+  }
+};
+
+/**
+ * The same decorators resolved at compile time. Each one is a mixin that
+ * derives from the layer it wraps, so a whole stack is a single object whose
+ * Operation calls are all direct and can be inlined. kLength is the exact
+ * output size, so a buffer can be sized once.
+ */
+class StaticComponent {
+ public:
+  static constexpr std::string_view kText = "ConcreteComponent";
+  static constexpr size_t kLength = kText.size();
+
+  void Operation(OutputBuffer& out) const {
+    out.Append(kText);
+  }
+};
+
+template <typename Inner>
+class StaticDecoratorA : public Inner {
+ public:
+  static constexpr std::string_view kPrefix = "ConcreteDecoratorA(";
+  static constexpr size_t kLength = kPrefix.size() + Inner::kLength + 1;
+
+  void Operation(OutputBuffer& out) const {
+    out.Append(kPrefix);
+    Inner::Operation(out);
+    out.Append(")");
+  }
+};
+
+template <typename Inner>
+class StaticDecoratorB : public Inner {
+ public:
+  static constexpr std::string_view kPrefix = "ConcreteDecoratorB(";
+  static constexpr size_t kLength = kPrefix.size() + Inner::kLength + 1;
+
+  void Operation(OutputBuffer& out) const {
+    out.Append(kPrefix);
+    Inner::Operation(out);
+    out.Append(")");
+  }
 };
 
+/**
+ * Compose<Core, A, B>::type is B<A<Core>>: layers are listed from the inside
+ * out, in the order they would be wrapped at runtime.
+ */
+template <typename Core, template <typename> class... Layers>
+struct Compose {
+  using type = Core;
+};
+
+template <typename Core, template <typename> class First, template <typename> class... Rest>
+struct Compose<Core, First, Rest...> {
+  using type = typename Compose<First<Core>, Rest...>::type;
+};
+
+/**
+ * A 16-layer stack, alternating A and B, through the three paths.
+ */
+void BenchmarkDecorators() {
+  constexpr int kLayers = 16;
+  constexpr size_t kOperations = 200000;
+  using StaticStack = Compose<StaticComponent, StaticDecoratorA, StaticDecoratorB, StaticDecoratorA, StaticDecoratorB,
+                              StaticDecoratorA, StaticDecoratorB, StaticDecoratorA, StaticDecoratorB, StaticDecoratorA,
+                              StaticDecoratorB, StaticDecoratorA, StaticDecoratorB, StaticDecoratorA, StaticDecoratorB,
+                              StaticDecoratorA, StaticDecoratorB>::type;
+
+  std::vector<Component*> stack = {new ConcreteComponent};
+  for (int i = 0; i < kLayers; ++i) {
+    if (i % 2 == 0) {
+      stack.push_back(new ConcreteDecoratorA(stack.back()));
+    } else {
+      stack.push_back(new ConcreteDecoratorB(stack.back()));
+    }
+  }
+  const Component& top = *stack.back();
+  const StaticStack static_stack;
+  size_t checksum = 0;
+
+  auto measure = [&](const char* name, auto operation) {
+    size_t allocations = allocation_count;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kOperations; ++i) {
+      checksum += operation();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << static_cast<double>(allocation_count - allocations) / kOperations << " allocations/op, "
+              << elapsed / kOperations << " ns/op\n";
+  };
+  measure("std::string Operation():      ", [&] { return top.Operation().size(); });
+  OutputBuffer buffer(StaticStack::kLength);
+  measure("Operation(OutputBuffer&):     ", [&] {
+    buffer.Clear();
+    top.Operation(buffer);
+    return buffer.size();
+  });
+  measure("Static mixin chain:           ", [&] {
+    buffer.Clear();
+    static_stack.Operation(buffer);
+    return buffer.size();
+  });
+
+  buffer.Clear();
+  static_stack.Operation(buffer);
+  bool same = buffer.view() == top.Operation() && checksum == 3 * kOperations * StaticStack::kLength;
+  std::cout << (same ? "All paths produce the same text.\n" : "Paths disagree!\n");
+  for (Component* component : stack) {
+    delete component;
+  }
+}
+
 /**
  * Client code works with all objects using the Component interface.
  * In this way, it remains independent of the specific component classes with which it
@@ -114,5 +284,8 @@ int main()
   delete decorator1;
   delete decorator2;
 
+  std::cout << "\n";
+  BenchmarkDecorators();
+
   return 0;
 }
\ No newline at end of file
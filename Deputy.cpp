@@ -1,4 +1,17 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 /**
  * The Subject interface declares common operations for both the Real Subject and the
@@ -7,7 +20,14 @@
  */
 class Subject {
  public:
+  virtual ~Subject() {
+  }
   virtual void Request() const = 0;
+  /**
+   * A request that produces a result for a key, e.g. a lookup in a slow
+   * backend.
+   */
+  virtual std::string Query(const std::string &key) const = 0;
 };
 
 /**
@@ -22,6 +42,11 @@ class RealSubject : public Subject {
   void Request() const override {
     std::cout << "RealSubject: Handling request.\n";
   }
+  std::string Query(const std::string &key) const override {
+    // This emulates a slow backend.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return "value of " + key;
+  }
 };
 /**
  * The interface of the Substitute is identical to that of the Real Subject.
@@ -67,6 +92,253 @@ class Proxy : public Subject {
       this->LogAccess();
     }
   }
+  std::string Query(const std::string &key) const override {
+    if (this->CheckAccess()) {
+      std::string result = this->real_subject_->Query(key);
+      this->LogAccess();
+      return result;
+    }
+    return {};
+  }
+};
+
+/**
+ * Collects access log lines and writes them from a background thread in
+ * batches, so logging never blocks a request on std::cout.
+ */
+class AccessLog {
+ public:
+  AccessLog() : writer_([this] { this->WriterLoop(); }) {
+  }
+  ~AccessLog() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->stopping_ = true;
+    }
+    this->changed_.notify_one();
+    this->writer_.join();
+  }
+  void Append(std::string line) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->pending_.push_back(std::move(line));
+    }
+    this->changed_.notify_one();
+  }
+
+ private:
+  void WriterLoop() {
+    std::vector<std::string> batch;
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    for (;;) {
+      this->changed_.wait(lock, [this] { return this->stopping_ || !this->pending_.empty(); });
+      batch.swap(this->pending_);
+      const bool stopping = this->stopping_;
+      lock.unlock();
+      std::string text;
+      for (const std::string &line : batch) {
+        text += line;
+        text += '\n';
+      }
+      std::cout << text;
+      batch.clear();
+      lock.lock();
+      if (stopping && this->pending_.empty()) {
+        return;
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<std::string> pending_;
+  bool stopping_ = false;
+  std::thread writer_;
+};
+
+/**
+ * A proxy that does everything the plain one only talks about:
+ *
+ * - the real subject is created on first use, not in the constructor;
+ * - Query results are cached for `ttl` and the least recently used entry is
+ *   evicted once `capacity` is reached;
+ * - concurrent misses on the same key are coalesced, so the real subject
+ *   computes each value once while the other callers wait for it;
+ * - an access check is reused for `access_ttl`, and logging is batched on a
+ *   background thread.
+ *
+ * It may be used from many threads at once.
+ */
+class CachingProxy : public Subject {
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    std::string key;
+    std::string value;
+    Clock::time_point expires;
+  };
+
+ public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t coalesced = 0;
+    uint64_t evictions = 0;
+    uint64_t expirations = 0;
+    double mean_hit_ns = 0;
+    double mean_miss_ns = 0;
+  };
+
+  CachingProxy(std::function<std::unique_ptr<RealSubject>()> factory, size_t capacity = 1024,
+               std::chrono::milliseconds ttl = std::chrono::seconds(60),
+               std::chrono::milliseconds access_ttl = std::chrono::seconds(1))
+      : factory_(std::move(factory)), capacity_(capacity), ttl_(ttl), access_ttl_(access_ttl) {
+  }
+
+  void Request() const override {
+    if (this->CheckAccess()) {
+      this->real_subject().Request();
+      this->log_.Append("CachingProxy: Request forwarded.");
+    }
+  }
+
+  std::string Query(const std::string &key) const override {
+    const Clock::time_point start = Clock::now();
+    if (!this->CheckAccess()) {
+      return {};
+    }
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    auto it = this->index_.find(key);
+    if (it != this->index_.end()) {
+      if (it->second->expires > start) {
+        this->lru_.splice(this->lru_.begin(), this->lru_, it->second);
+        std::string value = it->second->value;
+        lock.unlock();
+        this->Record(this->hits_, this->hit_ns_, start);
+        return value;
+      }
+      this->lru_.erase(it->second);
+      this->index_.erase(it);
+      ++this->expirations_;
+    }
+
+    auto flight = this->in_flight_.find(key);
+    if (flight != this->in_flight_.end()) {
+      std::shared_future<std::string> pending = flight->second;
+      lock.unlock();
+      std::string value = pending.get();
+      this->coalesced_.fetch_add(1, std::memory_order_relaxed);
+      this->Record(this->hits_, this->hit_ns_, start);
+      return value;
+    }
+    std::promise<std::string> promise;
+    this->in_flight_.emplace(key, promise.get_future().share());
+    lock.unlock();
+
+    std::string value;
+    try {
+      value = this->real_subject().Query(key);
+    } catch (...) {
+      // Fail this load for everyone waiting on it, but let the next caller
+      // retry instead of finding the key stuck in flight.
+      lock.lock();
+      this->in_flight_.erase(key);
+      lock.unlock();
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+    this->log_.Append("CachingProxy: Loaded " + key + ".");
+
+    lock.lock();
+    this->Insert(key, value, Clock::now() + this->ttl_);
+    this->in_flight_.erase(key);
+    lock.unlock();
+    promise.set_value(value);
+    this->Record(this->misses_, this->miss_ns_, start);
+    return value;
+  }
+
+  Stats GetStats() const {
+    Stats stats;
+    stats.hits = this->hits_.load(std::memory_order_relaxed);
+    stats.misses = this->misses_.load(std::memory_order_relaxed);
+    stats.coalesced = this->coalesced_.load(std::memory_order_relaxed);
+    stats.mean_hit_ns = stats.hits ? static_cast<double>(this->hit_ns_.load(std::memory_order_relaxed)) / stats.hits : 0;
+    stats.mean_miss_ns = stats.misses ? static_cast<double>(this->miss_ns_.load(std::memory_order_relaxed)) / stats.misses : 0;
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    stats.evictions = this->evictions_;
+    stats.expirations = this->expirations_;
+    return stats;
+  }
+
+ private:
+  const RealSubject &real_subject() const {
+    std::call_once(this->created_, [this] { this->real_subject_ = this->factory_(); });
+    return *this->real_subject_;
+  }
+
+  bool CheckAccess() const {
+    const int64_t now = Clock::now().time_since_epoch().count();
+    if (now < this->access_valid_until_.load(std::memory_order_acquire)) {
+      return true;
+    }
+    // Some real checks have to take place here.
+    this->log_.Append("CachingProxy: Checked access.");
+    this->access_valid_until_.store(now + std::chrono::duration_cast<Clock::duration>(this->access_ttl_).count(),
+                                    std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Must be called with mutex_ held.
+   */
+  void Insert(const std::string &key, std::string value, Clock::time_point expires) const {
+    auto it = this->index_.find(key);
+    if (it != this->index_.end()) {
+      this->lru_.erase(it->second);
+      this->index_.erase(it);
+    }
+    if (this->capacity_ == 0) {
+      return;
+    }
+    if (this->index_.size() >= this->capacity_) {
+      this->index_.erase(this->lru_.back().key);
+      this->lru_.pop_back();
+      ++this->evictions_;
+    }
+    this->lru_.push_front({key, std::move(value), expires});
+    this->index_.emplace(key, this->lru_.begin());
+  }
+
+  void Record(std::atomic<uint64_t> &count, std::atomic<uint64_t> &total_ns, Clock::time_point start) const {
+    count.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(),
+                       std::memory_order_relaxed);
+  }
+
+  std::function<std::unique_ptr<RealSubject>()> factory_;
+  mutable std::once_flag created_;
+  mutable std::unique_ptr<RealSubject> real_subject_;
+
+  const size_t capacity_;
+  const std::chrono::milliseconds ttl_;
+  const std::chrono::milliseconds access_ttl_;
+  mutable std::atomic<int64_t> access_valid_until_{0};
+
+  mutable std::mutex mutex_;
+  mutable std::list<Entry> lru_;
+  mutable std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  mutable std::unordered_map<std::string, std::shared_future<std::string>> in_flight_;
+  mutable uint64_t evictions_ = 0;
+  mutable uint64_t expirations_ = 0;
+
+  mutable std::atomic<uint64_t> hits_{0};
+  mutable std::atomic<uint64_t> misses_{0};
+  mutable std::atomic<uint64_t> coalesced_{0};
+  mutable std::atomic<uint64_t> hit_ns_{0};
+  mutable std::atomic<uint64_t> miss_ns_{0};
+
+  mutable AccessLog log_;
 };
 
 /**
@@ -94,5 +366,26 @@ int main() {
 
   delete real_subject;
   delete proxy;
+
+  std::cout << "\nClient: Eight threads asking a caching proxy for the same keys:\n";
+  {
+    CachingProxy caching([] { return std::make_unique<RealSubject>(); }, 2, std::chrono::milliseconds(200));
+    std::vector<std::thread> clients;
+    for (int t = 0; t < 8; ++t) {
+      clients.emplace_back([&caching] {
+        for (const char *key : {"alpha", "alpha", "beta", "alpha", "gamma", "alpha"}) {
+          caching.Query(key);
+        }
+      });
+    }
+    for (std::thread &client : clients) {
+      client.join();
+    }
+    const CachingProxy::Stats stats = caching.GetStats();
+    std::cout << "CachingProxy: " << stats.hits << " hits (" << stats.coalesced << " coalesced), " << stats.misses
+              << " misses, " << stats.evictions << " evictions, " << stats.expirations << " expirations; mean hit "
+              << static_cast<uint64_t>(stats.mean_hit_ns) << " ns, mean miss " << static_cast<uint64_t>(stats.mean_miss_ns)
+              << " ns\n";
+  }
   return 0;
 }
\ No newline at end of file
@@ -1,3 +1,16 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 /**
  * The subsystem can accept requests either from the facade or from the client directly.
  * In either case, for the Subsystem, the Facade is another client and is not
@@ -5,6 +18,12 @@
  */
 class Subsystem1 {
  public:
+  /**
+   * `startup` emulates a slow, I/O-bound initialization.
+   */
+  explicit Subsystem1(std::chrono::milliseconds startup = std::chrono::milliseconds(0)) {
+    std::this_thread::sleep_for(startup);
+  }
   std::string Operation1() const {
     return "Subsystem1: Ready!\n";
   }
@@ -18,6 +37,9 @@ class Subsystem1 {
  */
 class Subsystem2 {
  public:
+  explicit Subsystem2(std::chrono::milliseconds startup = std::chrono::milliseconds(0)) {
+    std::this_thread::sleep_for(startup);
+  }
   std::string Operation1() const {
     return "Subsystem2: Get ready!\n";
   }
@@ -71,6 +93,203 @@ class Facade {
   }
 };
 
+/**
+ * A value built by its factory on the first Get(), exactly once, whichever
+ * thread gets there first.
+ */
+template <typename T>
+class Lazy {
+ public:
+  explicit Lazy(std::function<std::unique_ptr<T>()> factory) : factory_(std::move(factory)) {
+  }
+  T &Get() {
+    std::call_once(this->once_, [this] { this->value_ = this->factory_(); });
+    return *this->value_;
+  }
+
+ private:
+  std::function<std::unique_ptr<T>()> factory_;
+  std::once_flag once_;
+  std::unique_ptr<T> value_;
+};
+
+/**
+ * Startup steps and their dependencies. Run() executes every step as soon as
+ * the steps it depends on have finished, on up to `threads` threads. A step
+ * may only depend on steps added before it, so the graph cannot have cycles;
+ * Add() throws std::invalid_argument otherwise. If a step throws, Run() starts
+ * no further steps, waits for the running ones and rethrows the first
+ * exception.
+ */
+class StartupGraph {
+ public:
+  size_t Add(std::function<void()> step, std::vector<size_t> dependencies = {}) {
+    size_t index = this->steps_.size();
+    for (size_t dependency : dependencies) {
+      if (dependency >= index) {
+        throw std::invalid_argument("StartupGraph::Add: a step may only depend on steps added before it");
+      }
+    }
+    this->steps_.push_back({std::move(step), {}, dependencies.size()});
+    for (size_t dependency : dependencies) {
+      this->steps_[dependency].dependents.push_back(index);
+    }
+    return index;
+  }
+
+  void Run(size_t threads) {
+    std::vector<size_t> ready;
+    std::vector<size_t> waiting(this->steps_.size());
+    for (size_t i = 0; i < this->steps_.size(); ++i) {
+      waiting[i] = this->steps_[i].dependencies;
+      if (waiting[i] == 0) {
+        ready.push_back(i);
+      }
+    }
+    size_t finished = 0;
+    std::exception_ptr failure;
+    std::mutex mutex;
+    std::condition_variable changed;
+    auto worker = [&] {
+      std::unique_lock<std::mutex> lock(mutex);
+      for (;;) {
+        changed.wait(lock, [&] { return !ready.empty() || finished == this->steps_.size() || failure; });
+        if (ready.empty() || failure) {
+          return;
+        }
+        size_t step = ready.back();
+        ready.pop_back();
+        lock.unlock();
+        try {
+          this->steps_[step].run();
+        } catch (...) {
+          lock.lock();
+          if (!failure) {
+            failure = std::current_exception();
+          }
+          changed.notify_all();
+          return;
+        }
+        lock.lock();
+        ++finished;
+        for (size_t dependent : this->steps_[step].dependents) {
+          if (--waiting[dependent] == 0) {
+            ready.push_back(dependent);
+          }
+        }
+        changed.notify_all();
+      }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < std::max<size_t>(threads, 1); ++i) {
+      pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+  }
+
+ private:
+  struct Step {
+    std::function<void()> run;
+    std::vector<size_t> dependents;
+    size_t dependencies;
+  };
+  std::vector<Step> steps_;
+};
+
+/**
+ * A Facade for subsystems that are slow to start. They are constructed
+ * lazily on first use. Start() can also bring them up concurrently with a
+ * StartupGraph, off the critical path, before the first request. Operation()
+ * is idempotent, so its result is computed once and cached.
+ */
+class ConcurrentFacade {
+ public:
+  ConcurrentFacade(std::function<std::unique_ptr<Subsystem1>()> subsystem1,
+                   std::function<std::unique_ptr<Subsystem2>()> subsystem2)
+      : subsystem1_(std::move(subsystem1)),
+        subsystem2_(std::move(subsystem2)),
+        operation_([this] { return std::make_unique<std::string>(this->Compute()); }) {
+  }
+
+  /**
+   * Initializes both subsystems in parallel, then warms the Operation cache
+   * once both are up.
+   */
+  void Start() {
+    StartupGraph graph;
+    size_t subsystem1 = graph.Add([this] { this->subsystem1_.Get(); });
+    size_t subsystem2 = graph.Add([this] { this->subsystem2_.Get(); });
+    graph.Add([this] { this->operation_.Get(); }, {subsystem1, subsystem2});
+    graph.Run(2);
+  }
+
+  const std::string &Operation() {
+    return this->operation_.Get();
+  }
+
+ private:
+  std::string Compute() {
+    std::string result = "Facade initializes subsystems:\n";
+    result += this->subsystem1_.Get().Operation1();
+    result += this->subsystem2_.Get().Operation1();
+    result += "Facade orders subsystems to perform the action:\n";
+    result += this->subsystem1_.Get().OperationN();
+    result += this->subsystem2_.Get().OperationZ();
+    return result;
+  }
+
+  Lazy<Subsystem1> subsystem1_;
+  Lazy<Subsystem2> subsystem2_;
+  Lazy<std::string> operation_;
+};
+
+/**
+ * Time to the first result and the cost of repeated calls, with subsystems
+ * that each take 50 ms to start.
+ */
+void BenchmarkStartup() {
+  using Clock = std::chrono::steady_clock;
+  const std::chrono::milliseconds startup(50);
+  auto milliseconds = [](Clock::duration elapsed) {
+    return std::chrono::duration<double, std::milli>(elapsed).count();
+  };
+
+  Clock::time_point start = Clock::now();
+  Facade facade(new Subsystem1(startup), new Subsystem2(startup));
+  std::string result = facade.Operation();
+  std::cout << "Facade: first result after " << milliseconds(Clock::now() - start) << " ms\n";
+
+  start = Clock::now();
+  ConcurrentFacade lazy([&] { return std::make_unique<Subsystem1>(startup); },
+                        [&] { return std::make_unique<Subsystem2>(startup); });
+  std::cout << "ConcurrentFacade: constructed in " << milliseconds(Clock::now() - start) << " ms, ";
+  lazy.Start();
+  bool same = lazy.Operation() == result;
+  std::cout << "first result after " << milliseconds(Clock::now() - start) << " ms"
+            << (same ? "" : " (different result)") << "\n";
+
+  constexpr int kCalls = 100000;
+  size_t checksum = 0;
+  start = Clock::now();
+  for (int i = 0; i < kCalls; ++i) {
+    checksum += facade.Operation().size();
+  }
+  auto uncached = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / kCalls;
+  start = Clock::now();
+  for (int i = 0; i < kCalls; ++i) {
+    checksum += lazy.Operation().size();
+  }
+  auto cached = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / kCalls;
+  std::cout << "Operation(): " << uncached << " ns/call recomputed, " << cached << " ns/call cached"
+            << (checksum == 2 * kCalls * result.size() ? "" : " (size mismatch)") << "\n";
+}
+
 /**
  * Client code works with complex subsystems through a simple interface,
  * provided by Facade. When Facade manages the subsystem lifecycle,
@@ -96,5 +315,8 @@ int main() {
 
   delete facade;
 
+  std::cout << "\n";
+  BenchmarkStartup();
+
   return 0;
 }
\ No newline at end of file
@@ -5,10 +5,29 @@
  * objects without revealing their internal representation.
  */
  
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <iterator>
+#include <numeric>
+#include <ranges>
+#include <span>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 /**
  * C++ has its own implementation of iterator that works with a different
  * generics containers defined by the standard library.
@@ -18,19 +37,32 @@ template <typename T, typename U>
 class Iterator {
  public:
   typedef typename std::vector<T>::iterator iter_type;
-  Iterator(U *p_data, bool reverse = false) : m_p_data_(p_data)
+  Iterator(U *p_data, bool reverse = false) : m_p_data_(p_data), m_reverse_(reverse)
   {
-    m_it_ = m_p_data_->m_data_.begin();
+    First();
   }
 
+  /**
+   * A reverse iterator starts at the last element and, after the first one,
+   * moves to end() so IsDone works the same in both directions.
+   */
   void First() 
   {
     m_it_ = m_p_data_->m_data_.begin();
+    if (m_reverse_ && m_it_ != m_p_data_->m_data_.end()) {
+      m_it_ = m_p_data_->m_data_.end() - 1;
+    }
   }
 
   void Next() 
   {
-    m_it_++;
+    if (!m_reverse_) {
+      m_it_++;
+    } else if (m_it_ == m_p_data_->m_data_.begin()) {
+      m_it_ = m_p_data_->m_data_.end();
+    } else {
+      m_it_--;
+    }
   }
 
   bool IsDone() 
@@ -45,9 +77,69 @@ class Iterator {
 
  private:
   U *m_p_data_;
+  bool m_reverse_;
   iter_type m_it_;
 };
 
+/**
+ * A random access iterator that visits every `step`-th element starting at
+ * `first`. A negative step walks backwards, so with step -1 it is a plain
+ * reverse iterator. Positions are counted in steps, so no pointer is ever
+ * formed past the ends of the array.
+ */
+template <typename T>
+class StrideIterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using iterator_concept = std::random_access_iterator_tag;
+  using value_type = std::remove_cv_t<T>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = T *;
+  using reference = T &;
+
+  StrideIterator() = default;
+  StrideIterator(T *first, difference_type step, difference_type index) : m_first_(first), m_step_(step), m_index_(index)
+  {
+  }
+
+  reference operator*() const { return m_first_[m_index_ * m_step_]; }
+  pointer operator->() const { return &**this; }
+  reference operator[](difference_type n) const { return m_first_[(m_index_ + n) * m_step_]; }
+
+  StrideIterator &operator++() { ++m_index_; return *this; }
+  StrideIterator operator++(int) { StrideIterator old = *this; ++m_index_; return old; }
+  StrideIterator &operator--() { --m_index_; return *this; }
+  StrideIterator operator--(int) { StrideIterator old = *this; --m_index_; return old; }
+  StrideIterator &operator+=(difference_type n) { m_index_ += n; return *this; }
+  StrideIterator &operator-=(difference_type n) { m_index_ -= n; return *this; }
+  friend StrideIterator operator+(StrideIterator it, difference_type n) { return it += n; }
+  friend StrideIterator operator+(difference_type n, StrideIterator it) { return it += n; }
+  friend StrideIterator operator-(StrideIterator it, difference_type n) { return it -= n; }
+  friend difference_type operator-(const StrideIterator &a, const StrideIterator &b) { return a.m_index_ - b.m_index_; }
+  friend bool operator==(const StrideIterator &a, const StrideIterator &b) { return a.m_index_ == b.m_index_; }
+  friend auto operator<=>(const StrideIterator &a, const StrideIterator &b) { return a.m_index_ <=> b.m_index_; }
+
+ private:
+  T *m_first_ = nullptr;
+  difference_type m_step_ = 1;
+  difference_type m_index_ = 0;
+};
+
+/**
+ * The index-th of `parts` contiguous slices of `all`. The first
+ * size % parts slices get one extra element, so sizes differ by at most one.
+ * parts must not be 0 and index must be less than parts.
+ */
+template <typename T>
+std::span<T> ChunkOf(std::span<T> all, size_t index, size_t parts)
+{
+  assert(parts != 0 && index < parts);
+  size_t base = all.size() / parts;
+  size_t extra = all.size() % parts;
+  size_t begin = index * base + std::min(index, extra);
+  return all.subspan(begin, base + (index < extra ? 1 : 0));
+}
+
 /**
  * Specific Collections provide one or more methods to get
  * new iterator instances compatible with the collection class.
@@ -68,6 +160,69 @@ class Container
     return new Iterator<T, Container>(this);
   }
 
+  /**
+   * The same iterator by value, so it lives on the caller's stack.
+   */
+  Iterator<T, Container> Iterate(bool reverse = false)
+  {
+    return Iterator<T, Container>(this, reverse);
+  }
+
+  /**
+   * Standard contiguous iterators, so a Container works with range-for,
+   * std::ranges and the parallel algorithms.
+   */
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  iterator begin() { return m_data_.begin(); }
+  iterator end() { return m_data_.end(); }
+  const_iterator begin() const { return m_data_.begin(); }
+  const_iterator end() const { return m_data_.end(); }
+  auto rbegin() { return m_data_.rbegin(); }
+  auto rend() { return m_data_.rend(); }
+  T *data() { return m_data_.data(); }
+  size_t size() const { return m_data_.size(); }
+  void Reserve(size_t n) { m_data_.reserve(n); }
+
+  /**
+   * Every `step`-th element, walking backwards from the last one when step
+   * is negative. step must not be 0.
+   */
+  std::ranges::subrange<StrideIterator<T>> Strided(std::ptrdiff_t step)
+  {
+    assert(step != 0);
+    std::ptrdiff_t n = static_cast<std::ptrdiff_t>(m_data_.size());
+    std::ptrdiff_t stride = step < 0 ? -step : step;
+    std::ptrdiff_t count = (n + stride - 1) / stride;
+    T *first = step < 0 && n ? m_data_.data() + n - 1 : m_data_.data();
+    return {StrideIterator<T>(first, step, 0), StrideIterator<T>(first, step, count)};
+  }
+
+  /**
+   * The index-th of `parts` contiguous, nearly equal slices, for handing a
+   * container to several threads. parts must not be 0 and index must be
+   * less than parts.
+   */
+  std::span<T> Chunk(size_t index, size_t parts)
+  {
+    return ChunkOf(std::span<T>(m_data_), index, parts);
+  }
+
+  /**
+   * All slices of at most `chunk_size` elements, as a random access range of
+   * spans. chunk_size must not be 0.
+   */
+  auto Chunks(size_t chunk_size)
+  {
+    assert(chunk_size != 0);
+    size_t count = (m_data_.size() + chunk_size - 1) / chunk_size;
+    return std::views::iota(size_t{0}, count) | std::views::transform([this, chunk_size](size_t i) {
+             size_t begin = i * chunk_size;
+             return std::span<T>(m_data_.data() + begin, std::min(chunk_size, m_data_.size() - begin));
+           });
+  }
+
  private:
   std::vector<T> m_data_;
 };
@@ -81,7 +236,7 @@ class Data {
     m_data_ = a;
   }
 
-  int data() 
+  int data() const
   {
     return m_data_;
   }
@@ -90,6 +245,311 @@ class Data {
   int m_data_;
 };
 
+static_assert(std::ranges::contiguous_range<Container<int>>);
+static_assert(std::random_access_iterator<StrideIterator<int>>);
+static_assert(std::ranges::random_access_range<decltype(std::declval<Container<int> &>().Chunks(1))>);
+
+/**
+ * A read-only Container over a file of raw T records, mapped into memory
+ * rather than loaded. Pages are read on first touch and can be dropped again
+ * by the kernel, so a dataset larger than RAM streams through the same range
+ * interface as Container. If the file cannot be mapped the container is
+ * empty and is_open() is false.
+ */
+template <class T>
+class MappedContainer 
+{
+  static_assert(std::is_trivially_copyable_v<T>, "records are read straight from the file");
+
+ public:
+  explicit MappedContainer(const std::string &path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(T))) {
+      void *mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+        ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+        m_mapping_ = mapping;
+        m_bytes_ = info.st_size;
+      }
+    }
+    ::close(fd);
+  }
+  MappedContainer(const MappedContainer &) = delete;
+  MappedContainer &operator=(const MappedContainer &) = delete;
+  MappedContainer(MappedContainer &&other) noexcept
+      : m_mapping_(std::exchange(other.m_mapping_, nullptr)), m_bytes_(std::exchange(other.m_bytes_, 0))
+  {
+  }
+  ~MappedContainer()
+  {
+    if (m_mapping_) {
+      ::munmap(m_mapping_, m_bytes_);
+    }
+  }
+
+  bool is_open() const { return m_mapping_ != nullptr; }
+  const T *data() const { return static_cast<const T *>(m_mapping_); }
+  size_t size() const { return m_bytes_ / sizeof(T); }
+  const T *begin() const { return data(); }
+  const T *end() const { return data() + size(); }
+
+  /**
+   * The same slices as Container::Chunk. parts must not be 0 and index must
+   * be less than parts.
+   */
+  std::span<const T> Chunk(size_t index, size_t parts) const
+  {
+    return ChunkOf(std::span<const T>(data(), size()), index, parts);
+  }
+
+  /**
+   * Writes `records` to `path` in the layout MappedContainer reads.
+   */
+  static bool Write(const std::string &path, std::span<const T> records)
+  {
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    bool written = std::fwrite(records.data(), sizeof(T), records.size(), file) == records.size();
+    return std::fclose(file) == 0 && written;
+  }
+
+ private:
+  void *m_mapping_ = nullptr;
+  size_t m_bytes_ = 0;
+};
+
+/**
+ * Lazy adaptors. Filter, map and take are the standard views, which already
+ * compose with Container and MappedContainer:
+ *
+ *   container | std::views::filter(pred) | std::views::transform(f) | std::views::take(n) | Batch<64>()
+ *
+ * Nothing runs until the pipeline is iterated, and then every element goes
+ * through all stages in a single pass. Batch<N> adds the missing piece: it
+ * groups the elements into spans of up to N, gathered in a buffer inside the
+ * iterator, so batching does not allocate either.
+ */
+template <std::ranges::input_range R, size_t N>
+  requires std::ranges::view<R>
+class BatchView : public std::ranges::view_interface<BatchView<R, N>> {
+  using Value = std::ranges::range_value_t<R>;
+
+ public:
+  class iterator {
+   public:
+    using iterator_concept = std::input_iterator_tag;
+    using value_type = std::span<const Value>;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(BatchView *parent) : m_parent_(parent), m_it_(std::ranges::begin(parent->m_base_))
+    {
+      Fill();
+    }
+    iterator(iterator &&) = default;
+    iterator &operator=(iterator &&) = default;
+
+    value_type operator*() const { return value_type(m_buffer_.data(), m_count_); }
+    iterator &operator++()
+    {
+      Fill();
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+    friend bool operator==(const iterator &it, std::default_sentinel_t) { return it.m_count_ == 0; }
+
+   private:
+    void Fill()
+    {
+      m_count_ = 0;
+      auto end = std::ranges::end(m_parent_->m_base_);
+      while (m_count_ < N && m_it_ != end) {
+        m_buffer_[m_count_++] = *m_it_;
+        ++m_it_;
+      }
+    }
+
+    BatchView *m_parent_ = nullptr;
+    std::ranges::iterator_t<R> m_it_;
+    std::array<Value, N> m_buffer_;
+    size_t m_count_ = 0;
+  };
+
+  BatchView() = default;
+  explicit BatchView(R base) : m_base_(std::move(base))
+  {
+  }
+
+  iterator begin() { return iterator(this); }
+  std::default_sentinel_t end() const { return std::default_sentinel; }
+
+ private:
+  R m_base_;
+};
+
+template <size_t N>
+struct Batch {
+  template <std::ranges::viewable_range R>
+  friend auto operator|(R &&range, Batch)
+  {
+    return BatchView<std::views::all_t<R>, N>(std::views::all(std::forward<R>(range)));
+  }
+};
+
+/**
+ * Sums a container through each iteration path. `value` reads an int from an
+ * element so the same code serves Container<int> and Container<Data>.
+ */
+template <typename T, typename Value>
+void BenchmarkIteration(const char *name, Value value)
+{
+  constexpr size_t kElements = 1 << 24;
+  Container<T> container;
+  container.Reserve(kElements);
+  for (size_t i = 0; i < kElements; ++i) {
+    container.Add(T(static_cast<int>(i % 1000)));
+  }
+
+  // Best of five runs.
+  auto measure = [&](const char *path, auto sum) {
+    long long total = 0;
+    double seconds = 1e9;
+    for (int run = 0; run < 5; ++run) {
+      auto start = std::chrono::steady_clock::now();
+      total = sum();
+      seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::cout << name << path << static_cast<size_t>(kElements / seconds / 1e6) << " M elements/s (sum " << total << ")\n";
+  };
+  measure("First/Next (heap):   ", [&] {
+    long long total = 0;
+    Iterator<T, Container<T>> *it = container.CreateIterator();
+    for (it->First(); !it->IsDone(); it->Next()) {
+      total += value(*it->Current());
+    }
+    delete it;
+    return total;
+  });
+  measure("First/Next (stack):  ", [&] {
+    long long total = 0;
+    Iterator<T, Container<T>> it = container.Iterate();
+    for (it.First(); !it.IsDone(); it.Next()) {
+      total += value(*it.Current());
+    }
+    return total;
+  });
+  measure("range-for:           ", [&] {
+    long long total = 0;
+    for (const T &element : container) {
+      total += value(element);
+    }
+    return total;
+  });
+  measure("reverse First/Next:  ", [&] {
+    long long total = 0;
+    Iterator<T, Container<T>> it = container.Iterate(true);
+    for (it.First(); !it.IsDone(); it.Next()) {
+      total += value(*it.Current());
+    }
+    return total;
+  });
+  measure("Strided(-1):         ", [&] {
+    long long total = 0;
+    for (const T &element : container.Strided(-1)) {
+      total += value(element);
+    }
+    return total;
+  });
+  measure("Chunk x threads:     ", [&] {
+    size_t parts = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<long long> totals(parts);
+    std::vector<std::thread> threads;
+    for (size_t part = 0; part < parts; ++part) {
+      threads.emplace_back([&, part] {
+        long long total = 0;
+        for (const T &element : container.Chunk(part, parts)) {
+          total += value(element);
+        }
+        totals[part] = total;
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    return std::accumulate(totals.begin(), totals.end(), 0LL);
+  });
+}
+
+/**
+ * Keeps the even values, squares them, takes the first `take` results and
+ * sums them in batches of 64: once eagerly through temporary vectors, once as
+ * a fused lazy pipeline, and once as the same pipeline over a memory-mapped
+ * copy of the data.
+ */
+void BenchmarkPipelines()
+{
+  constexpr size_t kElements = 1 << 24;
+  constexpr size_t kTake = kElements / 4;
+  Container<int> container;
+  container.Reserve(kElements);
+  for (size_t i = 0; i < kElements; ++i) {
+    container.Add(static_cast<int>(i % 1000));
+  }
+  auto even = [](int value) { return value % 2 == 0; };
+  auto square = [](int value) { return static_cast<long long>(value) * value; };
+  auto sum_batches = [](auto &&batches) {
+    long long total = 0;
+    for (std::span<const long long> batch : batches) {
+      total += std::accumulate(batch.begin(), batch.end(), 0LL);
+    }
+    return total;
+  };
+
+  auto measure = [](const char *name, auto run) {
+    auto start = std::chrono::steady_clock::now();
+    long long total = run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << seconds * 1e3 << " ms (sum " << total << ")\n";
+  };
+  measure("Eager temporaries:     ", [&] {
+    std::vector<int> filtered;
+    std::copy_if(container.begin(), container.end(), std::back_inserter(filtered), even);
+    std::vector<long long> mapped(filtered.size());
+    std::transform(filtered.begin(), filtered.end(), mapped.begin(), square);
+    mapped.resize(std::min(mapped.size(), kTake));
+    std::vector<std::span<const long long>> batches;
+    for (size_t i = 0; i < mapped.size(); i += 64) {
+      batches.emplace_back(mapped.data() + i, std::min<size_t>(64, mapped.size() - i));
+    }
+    return sum_batches(batches);
+  });
+  measure("Fused pipeline:        ", [&] {
+    return sum_batches(container | std::views::filter(even) | std::views::transform(square) | std::views::take(kTake) |
+                       Batch<64>());
+  });
+
+  std::string path = (std::filesystem::temp_directory_path() / "iterator_pipeline.bin").string();
+  if (!MappedContainer<int>::Write(path, std::span<const int>(container.data(), container.size()))) {
+    std::cout << "Could not write " << path << "\n";
+    return;
+  }
+  {
+    MappedContainer<int> mapped(path);
+    measure("Fused pipeline (mmap): ", [&] {
+      return sum_batches(mapped | std::views::filter(even) | std::views::transform(square) | std::views::take(kTake) |
+                         Batch<64>());
+    });
+  }
+  std::filesystem::remove(path);
+}
+
 /**
  * The client code may or may not know about the Concrete Iterator or Collection
  * classes, for this implementation the container is generic so you can used
@@ -122,10 +582,27 @@ void ClientCode()
   }
   delete it;
   delete it2;
+
+  std::cout << "________________Reverse and strided iteration__________________________" << std::endl;
+  for (Iterator<int, Container<int>> rit = cont.Iterate(true); !rit.IsDone(); rit.Next()) {
+    std::cout << *rit.Current() << " ";
+  }
+  std::cout << std::endl;
+  for (int value : cont.Strided(3)) {
+    std::cout << value << " ";
+  }
+  std::cout << std::endl;
+  for (std::span<int> chunk : cont.Chunks(4)) {
+    std::cout << "[" << chunk.front() << ".." << chunk.back() << "] ";
+  }
+  std::cout << std::endl;
 }
 
 int main() 
 {
   ClientCode();
+  BenchmarkIteration<int>("Container<int>  ", [](int value) { return value; });
+  BenchmarkIteration<Data>("Container<Data> ", [](const Data &value) { return value.data(); });
+  BenchmarkPipelines();
   return 0;
 }
\ No newline at end of file
@@ -6,6 +6,27 @@
  * objects, instead of storing the same data in each object.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 struct SharedState
 {
     std::string brand_;
@@ -128,6 +149,419 @@ public:
     }
 };
 
+/**
+ * Stores every distinct string exactly once in large chunks and hands out
+ * views into them. The views stay valid for the lifetime of the arena, so
+ * shared states can refer to their fields without owning copies. Strings
+ * longer than a chunk get a block of their own outside the bump chunks.
+ */
+class StringArena
+{
+private:
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    std::vector<std::unique_ptr<char[]>> large_;
+    size_t used_ = kChunkSize;
+    std::unordered_set<std::string_view> interned_;
+
+    std::string_view Copy(std::string_view text)
+    {
+        if (text.empty())
+        {
+            return {};
+        }
+        if (text.size() > kChunkSize)
+        {
+            large_.push_back(std::make_unique<char[]>(text.size()));
+            std::memcpy(large_.back().get(), text.data(), text.size());
+            return {large_.back().get(), text.size()};
+        }
+        if (used_ + text.size() > kChunkSize)
+        {
+            chunks_.push_back(std::make_unique<char[]>(kChunkSize));
+            used_ = 0;
+        }
+        char *data = chunks_.back().get() + used_;
+        std::memcpy(data, text.data(), text.size());
+        used_ += text.size();
+        return {data, text.size()};
+    }
+
+public:
+    std::string_view Intern(std::string_view text)
+    {
+        auto it = interned_.find(text);
+        if (it != interned_.end())
+        {
+            return *it;
+        }
+        return *interned_.insert(Copy(text)).first;
+    }
+};
+
+/**
+ * The key of a shared state is its three fields; they are hashed directly
+ * instead of being glued into one string.
+ */
+struct SharedKey
+{
+    std::string_view brand_;
+    std::string_view model_;
+    std::string_view color_;
+
+    SharedKey(std::string_view brand, std::string_view model, std::string_view color)
+        : brand_(brand), model_(model), color_(color)
+    {
+    }
+    SharedKey(const SharedState &ss) : brand_(ss.brand_), model_(ss.model_), color_(ss.color_)
+    {
+    }
+};
+
+/**
+ * Transparent hash and equality let the map be searched with a SharedState
+ * (or anything convertible to SharedKey) without building a key first.
+ */
+struct SharedKeyHash
+{
+    using is_transparent = void;
+
+    size_t operator()(const SharedKey &key) const
+    {
+        std::hash<std::string_view> hash;
+        size_t seed = hash(key.brand_);
+        seed ^= hash(key.model_) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        seed ^= hash(key.color_) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+    size_t operator()(const SharedState &ss) const
+    {
+        return (*this)(SharedKey(ss));
+    }
+};
+
+struct SharedKeyEqual
+{
+    using is_transparent = void;
+
+    bool operator()(const SharedKey &a, const SharedKey &b) const
+    {
+        return a.brand_ == b.brand_ && a.model_ == b.model_ && a.color_ == b.color_;
+    }
+    bool operator()(const SharedState &a, const SharedKey &b) const
+    {
+        return (*this)(SharedKey(a), b);
+    }
+    bool operator()(const SharedKey &a, const SharedState &b) const
+    {
+        return (*this)(a, SharedKey(b));
+    }
+};
+
+/**
+ * A lightweight whose shared state lives in the factory's string arena. It is
+ * never copied: the factory hands out references that stay valid for as long
+ * as the factory exists.
+ */
+class InternedFlyweight
+{
+private:
+    SharedKey shared_state_;
+
+public:
+    explicit InternedFlyweight(const SharedKey &shared_state) : shared_state_(shared_state)
+    {
+    }
+    InternedFlyweight(const InternedFlyweight &) = delete;
+    InternedFlyweight &operator=(const InternedFlyweight &) = delete;
+
+    const SharedKey &shared_state() const
+    {
+        return shared_state_;
+    }
+    void Operation(const UniqueState &unique_state) const
+    {
+        std::cout << "Flyweight: Displaying shared ([ " << shared_state_.brand_ << " , " << shared_state_.model_ << " , "
+                  << shared_state_.color_ << " ]) and unique (" << unique_state << ") state.\n";
+    }
+};
+
+/**
+ * A factory for large fleets. Looking up an existing lightweight is a single
+ * hash lookup that allocates nothing; only a miss interns the fields and
+ * inserts the new entry.
+ */
+class InternedFlyweightFactory
+{
+private:
+    StringArena arena_;
+    std::deque<InternedFlyweight> storage_;
+    std::unordered_map<SharedKey, const InternedFlyweight *, SharedKeyHash, SharedKeyEqual> flyweights_;
+
+public:
+    InternedFlyweightFactory(std::initializer_list<SharedState> share_states)
+    {
+        for (const SharedState &ss : share_states)
+        {
+            this->GetFlyweight(ss);
+        }
+    }
+
+    /**
+     * Returns an existing lightweight with the specified state or creates a new one.
+     */
+    const InternedFlyweight &GetFlyweight(const SharedState &shared_state)
+    {
+        auto it = this->flyweights_.find(shared_state);
+        if (it != this->flyweights_.end())
+        {
+            return *it->second;
+        }
+        SharedKey key(arena_.Intern(shared_state.brand_), arena_.Intern(shared_state.model_), arena_.Intern(shared_state.color_));
+        const InternedFlyweight &flyweight = storage_.emplace_back(key);
+        this->flyweights_.try_emplace(flyweight.shared_state(), &flyweight);
+        return flyweight;
+    }
+    size_t size() const
+    {
+        return this->flyweights_.size();
+    }
+    void ListFlyweights() const
+    {
+        std::cout << "\nInternedFlyweightFactory: I have " << this->flyweights_.size() << " flyweights:\n";
+        for (const InternedFlyweight &flyweight : storage_)
+        {
+            const SharedKey &key = flyweight.shared_state();
+            std::cout << key.brand_ << "_" << key.model_ << "_" << key.color_ << "\n";
+        }
+    }
+};
+
+/**
+ * A factory that many ingestion threads can share. The key space is split
+ * into shards by hash, each with its own lock, arena and map. Lookups of
+ * existing lightweights only take their shard's lock in shared mode, so they
+ * never wait for each other; inserts contend only with work on the same
+ * shard.
+ */
+class ShardedFlyweightFactory
+{
+private:
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex_;
+        StringArena arena_;
+        std::deque<InternedFlyweight> storage_;
+        std::unordered_map<SharedKey, const InternedFlyweight *, SharedKeyHash, SharedKeyEqual> flyweights_;
+    };
+
+    std::vector<Shard> shards_;
+
+    Shard &ShardFor(const SharedState &shared_state)
+    {
+        // The low bits pick the bucket inside the shard's map, so use the high ones here.
+        const size_t hash = SharedKeyHash()(shared_state);
+        return shards_[(hash >> 32 ^ hash >> 16) % shards_.size()];
+    }
+
+public:
+    explicit ShardedFlyweightFactory(size_t shard_count = 64) : shards_(std::max<size_t>(shard_count, 1))
+    {
+    }
+
+    /**
+     * Returns an existing lightweight with the specified state or creates a new one.
+     * The reference stays valid for the lifetime of the factory.
+     */
+    const InternedFlyweight &GetFlyweight(const SharedState &shared_state)
+    {
+        Shard &shard = ShardFor(shared_state);
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+            auto it = shard.flyweights_.find(shared_state);
+            if (it != shard.flyweights_.end())
+            {
+                return *it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(shard.mutex_);
+        // Another thread may have inserted it between the two locks.
+        auto it = shard.flyweights_.find(shared_state);
+        if (it != shard.flyweights_.end())
+        {
+            return *it->second;
+        }
+        SharedKey key(shard.arena_.Intern(shared_state.brand_), shard.arena_.Intern(shared_state.model_),
+                      shard.arena_.Intern(shared_state.color_));
+        const InternedFlyweight &flyweight = shard.storage_.emplace_back(key);
+        shard.flyweights_.try_emplace(flyweight.shared_state(), &flyweight);
+        return flyweight;
+    }
+
+    /**
+     * The number of lightweights in each shard, to check that the keys spread evenly.
+     */
+    std::vector<size_t> Occupancy() const
+    {
+        std::vector<size_t> occupancy;
+        occupancy.reserve(shards_.size());
+        for (const Shard &shard : shards_)
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+            occupancy.push_back(shard.flyweights_.size());
+        }
+        return occupancy;
+    }
+    void ListOccupancy() const
+    {
+        const std::vector<size_t> occupancy = this->Occupancy();
+        size_t total = 0;
+        for (size_t count : occupancy)
+        {
+            total += count;
+        }
+        const auto [min, max] = std::minmax_element(occupancy.begin(), occupancy.end());
+        std::cout << "ShardedFlyweightFactory: " << total << " flyweights in " << occupancy.size()
+                  << " shards (min " << *min << ", max " << *max << " per shard)\n";
+    }
+};
+
+/**
+ * The external state of many cars kept as columns instead of one UniqueState
+ * object per car. Owners and plates are appended to two contiguous string
+ * pools addressed through offset arrays, and each record refers to its
+ * lightweight through a small index (uint16_t is enough for up to 65535
+ * distinct lightweights) rather than a pointer.
+ */
+template <typename Index = uint32_t>
+class ExtrinsicStateTable
+{
+private:
+    std::vector<const InternedFlyweight *> flyweights_;
+    std::unordered_map<const InternedFlyweight *, Index> flyweight_ids_;
+
+    std::vector<Index> flyweight_column_;
+    std::string owner_pool_;
+    std::vector<uint32_t> owner_offsets_{0};
+    std::string plates_pool_;
+    std::vector<uint32_t> plates_offsets_{0};
+
+    static std::string_view Slice(const std::string &pool, const std::vector<uint32_t> &offsets, size_t record)
+    {
+        return std::string_view(pool).substr(offsets[record], offsets[record + 1] - offsets[record]);
+    }
+
+public:
+    void Reserve(size_t records, size_t average_text_size = 16)
+    {
+        flyweight_column_.reserve(records);
+        owner_offsets_.reserve(records + 1);
+        plates_offsets_.reserve(records + 1);
+        owner_pool_.reserve(records * average_text_size);
+        plates_pool_.reserve(records * average_text_size);
+    }
+
+    /**
+     * Throws std::length_error rather than wrap once the table would exceed
+     * what its columns can address: 2^32 records or bytes of text per pool,
+     * and as many lightweights as Index can number.
+     */
+    void Add(const InternedFlyweight &flyweight, std::string_view owner, std::string_view plates)
+    {
+        constexpr size_t kMaxOffset = std::numeric_limits<uint32_t>::max();
+        if (size() >= kMaxOffset || owner.size() > kMaxOffset - owner_pool_.size() ||
+            plates.size() > kMaxOffset - plates_pool_.size())
+        {
+            throw std::length_error("ExtrinsicStateTable: more than 4 GiB of text or 2^32 records");
+        }
+        if (flyweights_.size() > std::numeric_limits<Index>::max() && !flyweight_ids_.count(&flyweight))
+        {
+            throw std::length_error("ExtrinsicStateTable: too many lightweights for the Index type");
+        }
+        auto [it, inserted] = flyweight_ids_.try_emplace(&flyweight, static_cast<Index>(flyweights_.size()));
+        if (inserted)
+        {
+            flyweights_.push_back(&flyweight);
+        }
+        flyweight_column_.push_back(it->second);
+        owner_pool_.append(owner);
+        owner_offsets_.push_back(static_cast<uint32_t>(owner_pool_.size()));
+        plates_pool_.append(plates);
+        plates_offsets_.push_back(static_cast<uint32_t>(plates_pool_.size()));
+    }
+
+    size_t size() const
+    {
+        return flyweight_column_.size();
+    }
+    std::string_view owner(size_t record) const
+    {
+        return Slice(owner_pool_, owner_offsets_, record);
+    }
+    std::string_view plates(size_t record) const
+    {
+        return Slice(plates_pool_, plates_offsets_, record);
+    }
+    const InternedFlyweight &flyweight(size_t record) const
+    {
+        return *flyweights_[flyweight_column_[record]];
+    }
+
+    /**
+     * Calls operation(flyweight, owner, plates) for every record in insertion
+     * order, walking the columns sequentially.
+     */
+    template <typename Operation>
+    void OperationAll(Operation &&operation) const
+    {
+        for (size_t record = 0; record < size(); ++record)
+        {
+            operation(*flyweights_[flyweight_column_[record]], owner(record), plates(record));
+        }
+    }
+
+    /**
+     * Calls operation(flyweight, records) once per lightweight with the indices
+     * of all records that share it, so per-lightweight work is done once per
+     * group instead of once per car. The grouping is a counting sort over the
+     * index column.
+     */
+    template <typename Operation>
+    void ForEachByFlyweight(Operation &&operation) const
+    {
+        std::vector<uint32_t> starts(flyweights_.size() + 1, 0);
+        for (Index id : flyweight_column_)
+        {
+            ++starts[id + 1];
+        }
+        for (size_t i = 1; i < starts.size(); ++i)
+        {
+            starts[i] += starts[i - 1];
+        }
+        std::vector<uint32_t> records(size());
+        std::vector<uint32_t> cursor(starts.begin(), starts.end() - 1);
+        for (size_t record = 0; record < size(); ++record)
+        {
+            records[cursor[flyweight_column_[record]]++] = static_cast<uint32_t>(record);
+        }
+        for (size_t id = 0; id < flyweights_.size(); ++id)
+        {
+            operation(*flyweights_[id], std::span<const uint32_t>(records.data() + starts[id], starts[id + 1] - starts[id]));
+        }
+    }
+
+    /**
+     * Bytes used by the columns themselves, excluding the lightweights.
+     */
+    size_t MemoryBytes() const
+    {
+        return flyweight_column_.capacity() * sizeof(Index) + owner_pool_.capacity() + plates_pool_.capacity() +
+               (owner_offsets_.capacity() + plates_offsets_.capacity()) * sizeof(uint32_t) +
+               flyweights_.capacity() * sizeof(const InternedFlyweight *);
+    }
+};
+
 // ...
 void AddCarToPoliceDatabase(
     FlyweightFactory &ff, const std::string &plates, const std::string &owner,
@@ -140,6 +574,188 @@ void AddCarToPoliceDatabase(
     flyweight.Operation({owner, plates});
 }
 
+/**
+ * Compares both factories on a hit-heavy workload (every car uses one of a
+ * handful of models) and a miss-heavy one (every car is a new combination).
+ * FlyweightFactory reports each lookup on std::cout, so the stream is muted
+ * while it runs.
+ */
+template <typename Factory>
+double NanosecondsPerLookup(Factory &factory, const std::vector<SharedState> &requests)
+{
+    volatile const void *sink = nullptr;
+    const auto start = std::chrono::steady_clock::now();
+    for (const SharedState &ss : requests)
+    {
+        const auto &flyweight = factory.GetFlyweight(ss);
+        sink = &flyweight;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    (void)sink;
+    return static_cast<double>(elapsed) / requests.size();
+}
+
+/**
+ * Interning an empty string first, then a string longer than a chunk, must
+ * leave every earlier view intact.
+ */
+void CheckStringArena()
+{
+    StringArena arena;
+    std::string_view empty = arena.Intern("");
+    std::string_view small = arena.Intern("small");
+    std::string large_text(100 * 1024, 'x');
+    std::string_view large = arena.Intern(large_text);
+    std::string_view after = arena.Intern("after");
+    bool intact = empty.empty() && small == "small" && large == large_text && after == "after";
+    std::cout << "StringArena: " << (intact ? "views intact" : "views corrupted (bug)") << "\n";
+}
+
+void BenchmarkFactories()
+{
+    constexpr size_t kRequests = 200000;
+    const std::vector<SharedState> models = {{"Chevrolet", "Camaro2018", "pink"}, {"Mercedes Benz", "C300", "black"},
+                                             {"Mercedes Benz", "C500", "red"}, {"BMW", "M5", "red"}, {"BMW", "X6", "white"}};
+    std::vector<SharedState> hits;
+    std::vector<SharedState> misses;
+    hits.reserve(kRequests);
+    misses.reserve(kRequests);
+    for (size_t i = 0; i < kRequests; ++i)
+    {
+        hits.push_back(models[i % models.size()]);
+        misses.push_back({"Brand" + std::to_string(i % 97), "Model" + std::to_string(i), "color" + std::to_string(i % 13)});
+    }
+
+    for (const auto &[name, requests] : {std::make_pair("hit-heavy", &hits), std::make_pair("miss-heavy", &misses)})
+    {
+        FlyweightFactory classic({{"Chevrolet", "Camaro2018", "pink"}});
+        InternedFlyweightFactory interned({{"Chevrolet", "Camaro2018", "pink"}});
+        std::cout.setstate(std::ios::failbit);
+        const double classic_ns = NanosecondsPerLookup(classic, *requests);
+        std::cout.clear();
+        const double interned_ns = NanosecondsPerLookup(interned, *requests);
+        std::cout << name << ": FlyweightFactory " << classic_ns << " ns/lookup, InternedFlyweightFactory "
+                  << interned_ns << " ns/lookup\n";
+    }
+}
+
+/**
+ * Splits a batch of car records across a growing number of threads that all
+ * feed the same sharded factory.
+ */
+void BenchmarkParallelIngestion()
+{
+    constexpr size_t kRecords = 1000000;
+    std::vector<SharedState> records;
+    records.reserve(kRecords);
+    for (size_t i = 0; i < kRecords; ++i)
+    {
+        records.push_back({"Brand" + std::to_string(i % 61), "Model" + std::to_string(i % 1009), "color" + std::to_string(i % 7)});
+    }
+
+    const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        ShardedFlyweightFactory factory;
+        std::vector<std::thread> pool;
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            pool.emplace_back([&, t] {
+                const size_t begin = kRecords * t / threads;
+                const size_t end = kRecords * (t + 1) / threads;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    factory.GetFlyweight(records[i]);
+                }
+            });
+        }
+        for (std::thread &thread : pool)
+        {
+            thread.join();
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << threads << " threads: " << (elapsed ? kRecords * 1000 / elapsed : 0) << " records/ms, ";
+        factory.ListOccupancy();
+    }
+}
+
+/**
+ * Loads the same cars into the per-object layout (one UniqueState plus a
+ * lightweight pointer each) and into the columnar table, then compares their
+ * memory per record and the time of a full scan.
+ */
+void BenchmarkExtrinsicStateTable()
+{
+    constexpr size_t kCars = 1000000;
+    InternedFlyweightFactory factory({});
+    std::vector<const InternedFlyweight *> models;
+    for (int m = 0; m < 300; ++m)
+    {
+        models.push_back(&factory.GetFlyweight({"Brand" + std::to_string(m % 20), "Model" + std::to_string(m), "black"}));
+    }
+
+    struct Car
+    {
+        const InternedFlyweight *flyweight_;
+        UniqueState unique_state_;
+    };
+    std::vector<Car> objects;
+    objects.reserve(kCars);
+    ExtrinsicStateTable<uint16_t> table;
+    table.Reserve(kCars, 20);
+    size_t object_heap_bytes = 0;
+    for (size_t i = 0; i < kCars; ++i)
+    {
+        std::string owner = "Owner number " + std::to_string(i);
+        std::string plates = "CL" + std::to_string(100000 + i) + "IR";
+        const InternedFlyweight &flyweight = *models[i % models.size()];
+        table.Add(flyweight, owner, plates);
+        for (const std::string *text : {&owner, &plates})
+        {
+            // Strings longer than the small-string buffer live on the heap.
+            if (text->size() > std::string().capacity())
+            {
+                object_heap_bytes += text->size() + 1;
+            }
+        }
+        objects.push_back({&flyweight, UniqueState(owner, plates)});
+    }
+
+    size_t objects_sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Car &car : objects)
+    {
+        objects_sum += car.flyweight_->shared_state().brand_.size() + car.unique_state_.owner_.size() + car.unique_state_.plates_.size();
+    }
+    const auto objects_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    size_t columns_sum = 0;
+    start = std::chrono::steady_clock::now();
+    table.OperationAll([&](const InternedFlyweight &flyweight, std::string_view owner, std::string_view plates) {
+        columns_sum += flyweight.shared_state().brand_.size() + owner.size() + plates.size();
+    });
+    const auto columns_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    size_t groups_sum = 0;
+    start = std::chrono::steady_clock::now();
+    table.ForEachByFlyweight([&](const InternedFlyweight &flyweight, std::span<const uint32_t> records) {
+        const size_t brand = flyweight.shared_state().brand_.size();
+        for (uint32_t record : records)
+        {
+            groups_sum += brand + table.owner(record).size() + table.plates(record).size();
+        }
+    });
+    const auto groups_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\nPer-object layout: " << std::fixed << std::setprecision(1)
+              << static_cast<double>(objects.capacity() * sizeof(Car) + object_heap_bytes) / kCars << " bytes/car, scan "
+              << objects_us << " us\n";
+    std::cout << "Columnar table:    " << static_cast<double>(table.MemoryBytes()) / kCars << " bytes/car, scan "
+              << columns_us << " us, grouped scan " << groups_us << " us"
+              << (objects_sum == columns_sum && columns_sum == groups_sum ? "" : " (checksum mismatch)") << "\n";
+}
+
 /**
  * Client code usually creates a bunch of pre-populated lightweights at the
  * application initialization phase.
@@ -168,5 +784,11 @@ int main()
     factory->ListFlyweights();
     delete factory;
 
+    std::cout << "\n";
+    CheckStringArena();
+    BenchmarkFactories();
+    BenchmarkParallelIngestion();
+    BenchmarkExtrinsicStateTable();
+
     return 0;
 }
\ No newline at end of file
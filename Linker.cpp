@@ -1,7 +1,20 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 /**
  * The Component base class declares common operations for both simple and
@@ -12,7 +25,7 @@ class Component {
    * @var Component
    */
  protected:
-  Component *parent_;
+  Component *parent_ = nullptr;
   /**
    * If necessary, the base Component can declare an interface to set
    * and retrieve the component's parent in a tree structure. It can also
@@ -26,6 +39,16 @@ class Component {
   Component *GetParent() const {
     return this->parent_;
   }
+  /**
+   * Tells the ancestors that the result of this subtree has changed. Plain
+   * components keep nothing cached and just pass the call up; caching
+   * components override it to drop their cached result.
+   */
+  virtual void Invalidate() {
+    if (this->parent_) {
+      this->parent_->Invalidate();
+    }
+  }
   /**
    * In some cases it is reasonable to define descendant control operations
    * directly in the base class Component. That way, you don't have to
@@ -82,6 +105,7 @@ class Composite : public Component {
   void Add(Component *component) override {
     this->children_.push_back(component);
     component->SetParent(this);
+    this->Invalidate();
   }
   /**
    * Have in mind that this method removes the pointer to the list but doesn't
@@ -91,10 +115,14 @@ class Composite : public Component {
   void Remove(Component *component) override {
     children_.remove(component);
     component->SetParent(nullptr);
+    this->Invalidate();
   }
   bool IsComposite() const override {
     return true;
   }
+  const std::list<Component *> &children() const {
+    return this->children_;
+  }
   /**
    * The container performs its basic logic in a special way. It goes through
    * recursively through all of its children, collecting and summarizing their results.
@@ -113,6 +141,370 @@ class Composite : public Component {
     return "Branch(" + result + ")";
   }
 };
+/**
+ * A container that remembers its last result. Queries on an unchanged
+ * subtree return the cached text; Add, Remove or a change in any descendant
+ * marks this node and its ancestors dirty, and the next query rebuilds only
+ * the dirty path, reusing the cached results of untouched siblings.
+ *
+ * The cache is not synchronized, so a tree must not be queried and modified
+ * from several threads at once.
+ */
+class CachedComposite : public Composite {
+ public:
+  void Invalidate() override {
+    // A dirty node always has dirty ancestors, so the walk can stop early.
+    if (this->dirty_) {
+      return;
+    }
+    this->dirty_ = true;
+    Component::Invalidate();
+  }
+  /**
+   * Returns the cached result without copying it.
+   */
+  const std::string &CachedOperation() const {
+    if (this->dirty_) {
+      this->cache_ = Composite::Operation();
+      this->dirty_ = false;
+    }
+    return this->cache_;
+  }
+  std::string Operation() const override {
+    return this->CachedOperation();
+  }
+
+ private:
+  mutable std::string cache_;
+  mutable bool dirty_ = true;
+};
+/**
+ * A leaf with state of its own. Whenever the state changes the leaf calls
+ * Invalidate so that cached ancestors recompute their result.
+ */
+class TaggedLeaf : public Leaf {
+ public:
+  explicit TaggedLeaf(int tag = 0) : tag_(tag) {
+  }
+  void SetTag(int tag) {
+    this->tag_ = tag;
+    this->Invalidate();
+  }
+  std::string Operation() const override {
+    return "Leaf" + std::to_string(this->tag_);
+  }
+
+ private:
+  int tag_;
+};
+/**
+ * A read-only copy of a component tree laid out for fast traversal. All nodes
+ * live in one array in breadth-first order, so the children of every
+ * composite are contiguous and are addressed by an index range instead of a
+ * list of separately allocated nodes. Operation produces exactly the same
+ * text as Component::Operation, but without recursion and into a single
+ * buffer whose final size is computed up front. Leaf texts are captured when
+ * the tree is flattened, so later changes to the leaves are not seen.
+ */
+class FlatTree {
+  struct Node {
+    uint32_t first_child;
+    uint32_t child_count;
+    bool composite;
+    size_t result_size;
+    // Where a leaf's text lives in leaf_text_.
+    size_t text_offset;
+  };
+
+ public:
+  explicit FlatTree(const Component *root) {
+    std::vector<const Component *> order{root};
+    for (size_t i = 0; i < order.size(); ++i) {
+      Node node{static_cast<uint32_t>(order.size()), 0, order[i]->IsComposite(), 0, leaf_text_.size()};
+      if (!node.composite) {
+        leaf_text_ += order[i]->Operation();
+        node.result_size = leaf_text_.size() - node.text_offset;
+      } else {
+        for (const Component *child : static_cast<const Composite *>(order[i])->children()) {
+          order.push_back(child);
+        }
+        node.child_count = static_cast<uint32_t>(order.size() - node.first_child);
+      }
+      nodes_.push_back(node);
+    }
+    // Children always come after their parent, so one backward pass is enough
+    // to know how long every subtree's text will be.
+    for (size_t i = nodes_.size(); i-- > 0;) {
+      Node &node = nodes_[i];
+      if (!node.composite) {
+        continue;
+      }
+      node.result_size = sizeof("Branch()") - 1 + (node.child_count ? node.child_count - 1 : 0);
+      for (uint32_t c = 0; c < node.child_count; ++c) {
+        node.result_size += nodes_[node.first_child + c].result_size;
+      }
+    }
+  }
+
+  size_t size() const {
+    return nodes_.size();
+  }
+
+  std::string Operation() const {
+    std::string result;
+    this->Operation(result);
+    return result;
+  }
+
+  /**
+   * Appends the result to the given buffer, growing it at most once.
+   */
+  void Operation(std::string &out) const {
+    out.reserve(out.size() + nodes_.front().result_size);
+    // Each entry is a composite being visited and the index of its next child.
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    uint32_t current = 0;
+    for (;;) {
+      const Node &node = nodes_[current];
+      if (node.composite) {
+        out += "Branch(";
+        if (node.child_count) {
+          stack.emplace_back(current, 1);
+          current = node.first_child;
+          continue;
+        }
+        out += ')';
+      } else {
+        out.append(leaf_text_, node.text_offset, node.result_size);
+      }
+      // Climb up until a composite with remaining children is found.
+      for (;;) {
+        if (stack.empty()) {
+          return;
+        }
+        auto &[parent, next] = stack.back();
+        const Node &parent_node = nodes_[parent];
+        if (next < parent_node.child_count) {
+          out += '+';
+          current = parent_node.first_child + next++;
+          break;
+        }
+        out += ')';
+        stack.pop_back();
+      }
+    }
+  }
+
+ private:
+  std::vector<Node> nodes_;
+  std::string leaf_text_;
+};
+
+/**
+ * A small work-stealing thread pool. Every worker has its own task deque: it
+ * pushes and pops new work at the back, while idle workers steal from the
+ * front of the others. Threads outside the pool submit into an extra shared
+ * deque. A thread waiting for its subtasks keeps running tasks meanwhile, so
+ * nested fork/join never deadlocks.
+ */
+class WorkStealingPool {
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+ public:
+  explicit WorkStealingPool(size_t threads) {
+    for (size_t i = 0; i <= threads; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back([this, i] {
+        current_ = {this, i};
+        while (!stopping_.load(std::memory_order_acquire)) {
+          if (!RunOne()) {
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_.wait_for(lock, std::chrono::milliseconds(1), [this] {
+              return queued_.load(std::memory_order_acquire) > 0 || stopping_.load(std::memory_order_acquire);
+            });
+          }
+        }
+      });
+    }
+  }
+  ~WorkStealingPool() {
+    stopping_.store(true, std::memory_order_release);
+    idle_.notify_all();
+    for (std::thread &worker : workers_) {
+      worker.join();
+    }
+  }
+  size_t size() const {
+    return workers_.size();
+  }
+
+  void Submit(std::function<void()> task) {
+    Queue &queue = *queues_[OwnIndex()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1, std::memory_order_release);
+    idle_.notify_one();
+  }
+
+  /**
+   * Runs one task, preferring the caller's own newest one and otherwise
+   * stealing the oldest task of another queue. Returns false if all queues
+   * were empty.
+   */
+  bool RunOne() {
+    const size_t own = OwnIndex();
+    std::function<void()> task;
+    for (size_t n = 0; n < queues_.size() && !task; ++n) {
+      const size_t index = (own + n) % queues_.size();
+      Queue &queue = *queues_[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (index == own) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    if (!task) {
+      return false;
+    }
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    task();
+    return true;
+  }
+
+  template <typename Done>
+  void WaitUntil(Done done) {
+    while (!done()) {
+      if (!RunOne()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+ private:
+  size_t OwnIndex() const {
+    return current_.first == this ? current_.second : workers_.size();
+  }
+
+  static thread_local std::pair<const WorkStealingPool *, size_t> current_;
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> queued_{0};
+  std::atomic<bool> stopping_{false};
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+};
+
+thread_local std::pair<const WorkStealingPool *, size_t> WorkStealingPool::current_{nullptr, 0};
+
+/**
+ * Evaluates Operation on a tree of ordinary Components in parallel. Composite
+ * subtrees larger than the threshold fork one task per child; smaller ones
+ * fall back to the sequential Component::Operation. The children's results
+ * are concatenated in their original order, so the text is identical to the
+ * sequential one.
+ */
+class ParallelEvaluator {
+ public:
+  ParallelEvaluator(WorkStealingPool &pool, size_t threshold = 4096) : pool_(pool), threshold_(threshold) {
+  }
+
+  std::string Operation(const Component *root) {
+    return this->Evaluate(root, this->CountUpTo(root, threshold_));
+  }
+
+ private:
+  /**
+   * Counts the nodes of a subtree but stops as soon as the count exceeds the
+   * limit, so deciding whether to split never costs more than the threshold.
+   */
+  size_t CountUpTo(const Component *component, size_t limit) const {
+    size_t count = 1;
+    if (component->IsComposite()) {
+      for (const Component *child : static_cast<const Composite *>(component)->children()) {
+        if (count > limit) {
+          break;
+        }
+        count += this->CountUpTo(child, limit - count);
+      }
+    }
+    return count;
+  }
+
+  std::string Evaluate(const Component *component, size_t size) {
+    if (!component->IsComposite() || size <= threshold_) {
+      return component->Operation();
+    }
+    const std::list<Component *> &list = static_cast<const Composite *>(component)->children();
+    const std::vector<const Component *> children(list.begin(), list.end());
+    std::vector<size_t> sizes(children.size());
+    for (size_t c = 0; c < children.size(); ++c) {
+      sizes[c] = this->CountUpTo(children[c], threshold_);
+    }
+    std::vector<std::string> results(children.size());
+    // Consecutive small children are grouped into one task of roughly
+    // `threshold_` nodes, so a composite with many leaves does not fork one
+    // task per leaf.
+    std::vector<std::pair<size_t, size_t>> chunks;
+    for (size_t begin = 0; begin < children.size();) {
+      size_t end = begin;
+      size_t nodes = 0;
+      while (end < children.size() && (end == begin || nodes + sizes[end] <= threshold_)) {
+        nodes += sizes[end++];
+      }
+      chunks.emplace_back(begin, end);
+      begin = end;
+    }
+    auto run = [this, &children, &sizes, &results](std::pair<size_t, size_t> chunk) {
+      for (size_t c = chunk.first; c < chunk.second; ++c) {
+        results[c] = this->Evaluate(children[c], sizes[c]);
+      }
+    };
+    std::atomic<size_t> remaining{chunks.size() - 1};
+    for (size_t c = 0; c + 1 < chunks.size(); ++c) {
+      pool_.Submit([&run, &remaining, chunk = chunks[c]] {
+        run(chunk);
+        remaining.fetch_sub(1, std::memory_order_release);
+      });
+    }
+    // The last chunk is evaluated by the current thread instead of being queued.
+    run(chunks.back());
+    pool_.WaitUntil([&remaining] { return remaining.load(std::memory_order_acquire) == 0; });
+
+    size_t length = sizeof("Branch()") - 1 + results.size() - 1;
+    for (const std::string &result : results) {
+      length += result.size();
+    }
+    std::string out;
+    out.reserve(length);
+    out += "Branch(";
+    for (size_t r = 0; r < results.size(); ++r) {
+      if (r) {
+        out += '+';
+      }
+      out += results[r];
+    }
+    out += ')';
+    return out;
+  }
+
+  WorkStealingPool &pool_;
+  const size_t threshold_;
+};
+
 /**
  * The client code works with all components through a basic interface.
  */
@@ -136,6 +528,160 @@ void ClientCode2(Component *component1, Component *component2) {
   // ...
 }
 
+/**
+ * Builds a tree of the given depth in which every composite has `width`
+ * children, the last of which is the next level; the others are leaves.
+ */
+Component *BuildTree(size_t depth, size_t width, std::vector<Component *> &nodes) {
+  Component *root = new Composite;
+  nodes.push_back(root);
+  Component *level = root;
+  for (size_t d = 0; d < depth; ++d) {
+    for (size_t w = 1; w < width; ++w) {
+      nodes.push_back(new Leaf);
+      level->Add(nodes.back());
+    }
+    nodes.push_back(new Composite);
+    level->Add(nodes.back());
+    level = nodes.back();
+  }
+  return root;
+}
+
+/**
+ * FlatTree must reproduce the text of every kind of leaf, not just Leaf.
+ */
+void CheckFlatTreeMixedLeaves() {
+  std::vector<Component *> nodes;
+  Component *root = BuildTree(3, 3, nodes);
+  for (int tag = 0; tag < 12; ++tag) {
+    Component *branch = new Composite;
+    nodes.push_back(branch);
+    nodes.push_back(new TaggedLeaf(tag * 37));
+    branch->Add(nodes.back());
+    nodes.push_back(new Leaf);
+    branch->Add(nodes.back());
+    root->Add(branch);
+  }
+  std::cout << "mixed tree: FlatTree " << (FlatTree(root).Operation() == root->Operation() ? "matches" : "MISMATCH")
+            << " the recursive Operation\n";
+  for (Component *node : nodes) {
+    delete node;
+  }
+}
+
+/**
+ * Compares the recursive Operation with FlatTree on a deep and a wide tree.
+ */
+void BenchmarkOperation() {
+  for (auto [name, depth, width] : {std::make_tuple("deep", size_t{2000}, size_t{2}),
+                                    std::make_tuple("wide", size_t{4}, size_t{250000})}) {
+    std::vector<Component *> nodes;
+    Component *root = BuildTree(depth, width, nodes);
+
+    auto start = std::chrono::steady_clock::now();
+    const std::string recursive = root->Operation();
+    const auto recursive_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    const FlatTree flat(root);
+    const auto flatten_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    const std::string iterative = flat.Operation();
+    const auto flat_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << " tree (" << nodes.size() << " nodes): recursive " << recursive_us << " us, flattening "
+              << flatten_us << " us, flat " << flat_us << " us" << (recursive == iterative ? "" : " (MISMATCH)") << "\n";
+    for (Component *node : nodes) {
+      delete node;
+    }
+  }
+}
+
+/**
+ * Runs the parallel evaluator on a wide tree of independent subtrees with an
+ * increasing number of workers.
+ */
+void BenchmarkParallelOperation() {
+  std::vector<Component *> nodes;
+  Component *root = new Composite;
+  nodes.push_back(root);
+  for (int s = 0; s < 64; ++s) {
+    root->Add(BuildTree(8, 2000, nodes));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  const std::string sequential = root->Operation();
+  const auto sequential_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "\nsequential (" << nodes.size() << " nodes): " << sequential_us << " us\n";
+
+  const size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    WorkStealingPool pool(threads);
+    ParallelEvaluator evaluator(pool, 4096);
+    start = std::chrono::steady_clock::now();
+    const std::string parallel = evaluator.Operation(root);
+    const auto parallel_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << threads << " workers: " << parallel_us << " us" << (parallel == sequential ? "" : " (MISMATCH)") << "\n";
+  }
+  for (Component *node : nodes) {
+    delete node;
+  }
+}
+
+/**
+ * Builds the same balanced tree from plain and from caching composites and
+ * runs a read-mostly workload on both: `reads_per_write` queries of the root
+ * for every mutation of a random leaf.
+ */
+template <typename Branch>
+Component *BuildBalancedTree(size_t depth, size_t fanout, std::vector<Component *> &nodes, std::vector<TaggedLeaf *> &leaves) {
+  if (depth == 0) {
+    leaves.push_back(new TaggedLeaf);
+    nodes.push_back(leaves.back());
+    return leaves.back();
+  }
+  Component *branch = new Branch;
+  nodes.push_back(branch);
+  for (size_t i = 0; i < fanout; ++i) {
+    branch->Add(BuildBalancedTree<Branch>(depth - 1, fanout, nodes, leaves));
+  }
+  return branch;
+}
+
+template <typename Branch>
+long long ReadMostlyMicroseconds(size_t reads_per_write, size_t writes) {
+  std::vector<Component *> nodes;
+  std::vector<TaggedLeaf *> leaves;
+  Component *root = BuildBalancedTree<Branch>(4, 8, nodes, leaves);
+  size_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t w = 0; w < writes; ++w) {
+    leaves[(w * 7919) % leaves.size()]->SetTag(static_cast<int>(w % 10));
+    for (size_t r = 0; r < reads_per_write; ++r) {
+      if constexpr (std::is_same_v<Branch, CachedComposite>) {
+        sink += static_cast<const CachedComposite *>(root)->CachedOperation().size();
+      } else {
+        sink += root->Operation().size();
+      }
+    }
+  }
+  const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  for (Component *node : nodes) {
+    delete node;
+  }
+  return sink ? elapsed : -1;
+}
+
+void BenchmarkCachedComposite() {
+  std::cout << "\n";
+  for (size_t reads_per_write : {size_t{1}, size_t{10}, size_t{100}}) {
+    std::cout << reads_per_write << " reads per write: Composite " << ReadMostlyMicroseconds<Composite>(reads_per_write, 50)
+              << " us, CachedComposite " << ReadMostlyMicroseconds<CachedComposite>(reads_per_write, 50) << " us\n";
+  }
+}
+
 /**
  * In this way, the client code can support simple leaf components...
  */
@@ -177,5 +723,10 @@ int main() {
   delete leaf_2;
   delete leaf_3;
 
+  CheckFlatTreeMixedLeaves();
+  BenchmarkOperation();
+  BenchmarkParallelOperation();
+  BenchmarkCachedComposite();
+
   return 0;
 }
\ No newline at end of file
@@ -1,5 +1,82 @@
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A lightweight handle for an event name interned by EventRegistry. It is
+ * cheap to pass and compare, and indexes the dispatch table directly.
+ */
+struct EventId
+{
+  uint32_t value;
+};
+
+/**
+ * Interns event names to dense ids. Events are meant to be registered at
+ * startup; the registry is not synchronized for concurrent interning.
+ */
+class EventRegistry
+{
+ private:
+  std::unordered_map<std::string, uint32_t> ids_;
+  std::vector<std::string> names_;
+
+ public:
+  EventId Intern(std::string_view name)
+  {
+    auto [it, inserted] = this->ids_.try_emplace(std::string(name), static_cast<uint32_t>(this->names_.size()));
+    if (inserted)
+    {
+      this->names_.emplace_back(name);
+    }
+    return EventId{it->second};
+  }
+
+  std::optional<EventId> Find(const std::string &name) const
+  {
+    auto it = this->ids_.find(name);
+    if (it == this->ids_.end())
+    {
+      return std::nullopt;
+    }
+    return EventId{it->second};
+  }
+
+  const std::string &Name(EventId event) const
+  {
+    return this->names_[event.value];
+  }
+
+  size_t size() const
+  {
+    return this->names_.size();
+  }
+};
+
+EventRegistry &Events()
+{
+  static EventRegistry registry;
+  return registry;
+}
+
+const EventId kEventA = Events().Intern("A");
+const EventId kEventB = Events().Intern("B");
+const EventId kEventC = Events().Intern("C");
+const EventId kEventD = Events().Intern("D");
 
 /**
  * The Mediator interface provides a method used by components to
@@ -10,7 +87,18 @@ class BaseComponent;
 class Mediator
  {
  public:
+  virtual ~Mediator()
+  {
+  }
   virtual void Notify(BaseComponent *sender, std::string event) const = 0;
+  /**
+   * Mediators that only understand event names get the name looked up for
+   * them.
+   */
+  virtual void Notify(BaseComponent *sender, EventId event) const
+  {
+    this->Notify(sender, Events().Name(event));
+  }
 };
 
 /**
@@ -44,12 +132,12 @@ class Component1 : public BaseComponent
   void DoA() 
   {
     std::cout << "Component 1 does A.\n";
-    this->mediator_->Notify(this, "A");
+    this->mediator_->Notify(this, kEventA);
   }
   void DoB() 
   {
     std::cout << "Component 1 does B.\n";
-    this->mediator_->Notify(this, "B");
+    this->mediator_->Notify(this, kEventB);
   }
 };
 
@@ -59,13 +147,13 @@ class Component2 : public BaseComponent
   void DoC() 
   {
     std::cout << "Component 2 does C.\n";
-    this->mediator_->Notify(this, "C");
+    this->mediator_->Notify(this, kEventC);
   }
 
   void DoD()
   {
     std::cout << "Component 2 does D.\n";
-    this->mediator_->Notify(this, "D");
+    this->mediator_->Notify(this, kEventD);
   }
 };
 
@@ -86,6 +174,8 @@ class ConcreteMediator : public Mediator
     this->component2_->set_mediator(this);
   }
 
+  using Mediator::Notify;
+
   void Notify(BaseComponent *sender, std::string event) const override
   {
     if (event == "A") 
@@ -102,6 +192,446 @@ class ConcreteMediator : public Mediator
   }
 };
 
+/**
+ * A mediator whose reactions live in a flat table indexed by EventId, so a
+ * notification is one bounds check and one call however many events there
+ * are. Events without a handler are ignored.
+ */
+class RoutedMediator : public Mediator
+{
+ public:
+  using Handler = std::function<void(BaseComponent *)>;
+
+ private:
+  std::vector<Handler> table_;
+
+ public:
+  void On(EventId event, Handler handler)
+  {
+    if (event.value >= this->table_.size())
+    {
+      this->table_.resize(event.value + 1);
+    }
+    this->table_[event.value] = std::move(handler);
+  }
+
+  void Notify(BaseComponent *sender, EventId event) const override
+  {
+    if (event.value < this->table_.size() && this->table_[event.value])
+    {
+      this->table_[event.value](sender);
+    }
+  }
+
+  void Notify(BaseComponent *sender, std::string event) const override
+  {
+    if (std::optional<EventId> id = Events().Find(event))
+    {
+      this->Notify(sender, *id);
+    }
+  }
+};
+
+/**
+ * The string-comparing style of ConcreteMediator generalised to any number of
+ * events, for the benchmark below.
+ */
+class StringMediator : public Mediator
+{
+ private:
+  std::vector<std::pair<std::string, std::function<void(BaseComponent *)>>> reactions_;
+
+ public:
+  using Mediator::Notify;
+
+  void On(std::string event, std::function<void(BaseComponent *)> handler)
+  {
+    this->reactions_.emplace_back(std::move(event), std::move(handler));
+  }
+
+  void Notify(BaseComponent *sender, std::string event) const override
+  {
+    for (const auto &reaction : this->reactions_)
+    {
+      if (event == reaction.first)
+      {
+        reaction.second(sender);
+      }
+    }
+  }
+};
+
+void BenchmarkMediators()
+{
+  constexpr size_t kNotifications = 1000000;
+  for (size_t events : {4, 16, 64, 256, 1024})
+  {
+    StringMediator by_name;
+    RoutedMediator by_id;
+    std::vector<std::string> names;
+    std::vector<EventId> ids;
+    uint64_t handled = 0;
+    for (size_t e = 0; e < events; ++e)
+    {
+      names.push_back("component.event." + std::to_string(e));
+      ids.push_back(Events().Intern(names.back()));
+      by_name.On(names.back(), [&handled](BaseComponent *) { ++handled; });
+      by_id.On(ids.back(), [&handled](BaseComponent *) { ++handled; });
+    }
+    std::mt19937 random(42);
+    std::vector<uint32_t> stream(kNotifications);
+    for (uint32_t &e : stream)
+    {
+      e = static_cast<uint32_t>(random() % events);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t e : stream)
+    {
+      by_name.Notify(nullptr, names[e]);
+    }
+    double by_name_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t e : stream)
+    {
+      by_id.Notify(nullptr, ids[e]);
+    }
+    double by_id_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << events << " events: StringMediator " << static_cast<uint64_t>(kNotifications / by_name_seconds)
+              << " events/s, RoutedMediator " << static_cast<uint64_t>(kNotifications / by_id_seconds) << " events/s"
+              << (handled == 2 * kNotifications ? "" : " (handler count mismatch)") << "\n";
+  }
+}
+
+/**
+ * An unbounded multi-producer, single-consumer queue. Push is one atomic
+ * exchange, and a consumer never blocks producers. TryPop may briefly miss an
+ * element whose Push has not completed yet.
+ */
+template <typename T>
+class MpscQueue
+{
+ private:
+  struct Node
+  {
+    std::atomic<Node *> next{nullptr};
+    T value;
+  };
+
+  alignas(64) std::atomic<Node *> head_;
+  alignas(64) Node *tail_;
+  Node stub_;
+
+ public:
+  MpscQueue() : head_(&stub_), tail_(&stub_)
+  {
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  ~MpscQueue()
+  {
+    T value;
+    while (this->TryPop(value))
+    {
+    }
+    if (this->tail_ != &this->stub_)
+    {
+      delete this->tail_;
+    }
+  }
+
+  void Push(T value)
+  {
+    Node *node = new Node;
+    node->value = std::move(value);
+    Node *previous = this->head_.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  /**
+   * Consumer only.
+   */
+  bool TryPop(T &value)
+  {
+    Node *tail = this->tail_;
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr)
+    {
+      return false;
+    }
+    value = std::move(next->value);
+    this->tail_ = next;
+    if (tail != &this->stub_)
+    {
+      delete tail;
+    }
+    return true;
+  }
+};
+
+constexpr size_t kLatencyBuckets = 32;
+
+struct BusMetrics
+{
+  uint64_t dispatched = 0;
+  size_t depth = 0;
+  size_t max_depth = 0;
+  /**
+   * Bucket i counts dispatches that waited in [2^i, 2^(i+1)) ns (bucket 0
+   * also holds 0 ns).
+   */
+  std::array<uint64_t, kLatencyBuckets> latency_histogram{};
+
+  /**
+   * Upper bound of the bucket that holds the given fraction of dispatches.
+   */
+  uint64_t LatencyPercentileNs(double fraction) const
+  {
+    uint64_t target = static_cast<uint64_t>(fraction * this->dispatched);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kLatencyBuckets; ++i)
+    {
+      seen += this->latency_histogram[i];
+      if (seen > target)
+      {
+        return uint64_t{1} << (i + 1);
+      }
+    }
+    return uint64_t{1} << kLatencyBuckets;
+  }
+};
+
+/**
+ * An asynchronous mediator. Notify only enqueues the event, and dispatcher
+ * threads later run the reactions registered with On(), so a reaction that
+ * notifies again no longer nests inside its caller.
+ *
+ * Every sender maps to one dispatcher, either a hash of its address or the
+ * one chosen with Pin(). Events from a sender are therefore handled in order
+ * on the same thread. Register reactions and pins before events flow.
+ */
+class AsyncMediator : public Mediator
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct Envelope
+  {
+    BaseComponent *sender = nullptr;
+    EventId event{0};
+    Clock::time_point enqueued;
+  };
+
+  struct Dispatcher
+  {
+    MpscQueue<Envelope> queue;
+    alignas(64) std::atomic<uint64_t> signal{0};
+    std::atomic<bool> sleeping{false};
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<size_t> max_depth{0};
+    alignas(64) std::atomic<uint64_t> dispatched{0};
+    std::array<std::atomic<uint64_t>, kLatencyBuckets> latency_histogram{};
+    std::thread thread;
+  };
+
+  RoutedMediator routes_;
+  std::unordered_map<const BaseComponent *, size_t> pins_;
+  std::deque<Dispatcher> dispatchers_;
+  std::atomic<bool> stopping_{false};
+
+  alignas(64) mutable std::atomic<uint64_t> pending_{0};
+  mutable std::mutex flush_mutex_;
+  mutable std::condition_variable flushed_;
+
+  Dispatcher &DispatcherFor(const BaseComponent *sender) const
+  {
+    auto pin = this->pins_.find(sender);
+    size_t index = pin != this->pins_.end() ? pin->second
+                                            : std::hash<const BaseComponent *>()(sender) % this->dispatchers_.size();
+    return const_cast<Dispatcher &>(this->dispatchers_[index]);
+  }
+
+  void Run(Dispatcher &dispatcher)
+  {
+    Envelope envelope;
+    for (;;)
+    {
+      uint64_t seen = dispatcher.signal.load(std::memory_order_acquire);
+      bool drained_any = false;
+      while (dispatcher.queue.TryPop(envelope))
+      {
+        drained_any = true;
+        uint64_t waited = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - envelope.enqueued).count();
+        size_t bucket = std::min<size_t>(waited ? std::bit_width(waited) - 1 : 0, kLatencyBuckets - 1);
+        dispatcher.latency_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+        this->routes_.Notify(envelope.sender, envelope.event);
+        dispatcher.dispatched.fetch_add(1, std::memory_order_release);
+        if (this->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          std::lock_guard<std::mutex> lock(this->flush_mutex_);
+          this->flushed_.notify_all();
+        }
+      }
+      if (!drained_any)
+      {
+        if (this->stopping_.load(std::memory_order_acquire))
+        {
+          return;
+        }
+        // Producers only pay for a wake-up while the dispatcher sleeps.
+        dispatcher.sleeping.store(true);
+        if (dispatcher.signal.load() == seen)
+        {
+          dispatcher.signal.wait(seen);
+        }
+        dispatcher.sleeping.store(false, std::memory_order_relaxed);
+      }
+    }
+  }
+
+ public:
+  using Mediator::Notify;
+
+  explicit AsyncMediator(size_t threads = 1)
+  {
+    for (size_t i = 0; i < (threads ? threads : 1); ++i)
+    {
+      this->dispatchers_.emplace_back();
+    }
+    for (Dispatcher &dispatcher : this->dispatchers_)
+    {
+      dispatcher.thread = std::thread([this, &dispatcher] { this->Run(dispatcher); });
+    }
+  }
+
+  ~AsyncMediator()
+  {
+    this->Flush(std::chrono::seconds(10));
+    this->stopping_.store(true, std::memory_order_release);
+    for (Dispatcher &dispatcher : this->dispatchers_)
+    {
+      dispatcher.signal.fetch_add(1, std::memory_order_release);
+      dispatcher.signal.notify_one();
+    }
+    for (Dispatcher &dispatcher : this->dispatchers_)
+    {
+      dispatcher.thread.join();
+    }
+  }
+
+  void On(EventId event, RoutedMediator::Handler handler)
+  {
+    this->routes_.On(event, std::move(handler));
+  }
+
+  void Pin(const BaseComponent *component, size_t thread)
+  {
+    this->pins_[component] = thread % this->dispatchers_.size();
+  }
+
+  void Notify(BaseComponent *sender, EventId event) const override
+  {
+    Dispatcher &dispatcher = this->DispatcherFor(sender);
+    this->pending_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t enqueued = dispatcher.enqueued.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t dispatched = dispatcher.dispatched.load(std::memory_order_acquire);
+    size_t depth = enqueued > dispatched ? enqueued - dispatched : 0;
+    size_t max_depth = dispatcher.max_depth.load(std::memory_order_relaxed);
+    while (depth > max_depth && !dispatcher.max_depth.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed))
+    {
+    }
+    dispatcher.queue.Push(Envelope{sender, event, Clock::now()});
+    dispatcher.signal.fetch_add(1);
+    if (dispatcher.sleeping.load())
+    {
+      dispatcher.signal.notify_one();
+    }
+  }
+
+  void Notify(BaseComponent *sender, std::string event) const override
+  {
+    if (std::optional<EventId> id = Events().Find(event))
+    {
+      this->Notify(sender, *id);
+    }
+  }
+
+  /**
+   * Waits until every event notified so far, including any notified by
+   * reactions in the meantime, has been dispatched. Returns false if that
+   * takes longer than `timeout`.
+   */
+  bool Flush(std::chrono::milliseconds timeout) const
+  {
+    std::unique_lock<std::mutex> lock(this->flush_mutex_);
+    return this->flushed_.wait_for(lock, timeout,
+                                   [this] { return this->pending_.load(std::memory_order_acquire) == 0; });
+  }
+
+  BusMetrics Metrics() const
+  {
+    BusMetrics metrics;
+    for (const Dispatcher &dispatcher : this->dispatchers_)
+    {
+      uint64_t dispatched = dispatcher.dispatched.load(std::memory_order_acquire);
+      uint64_t enqueued = dispatcher.enqueued.load(std::memory_order_relaxed);
+      metrics.dispatched += dispatched;
+      metrics.depth += enqueued > dispatched ? enqueued - dispatched : 0;
+      metrics.max_depth = std::max(metrics.max_depth, dispatcher.max_depth.load(std::memory_order_relaxed));
+      for (size_t i = 0; i < kLatencyBuckets; ++i)
+      {
+        metrics.latency_histogram[i] += dispatcher.latency_histogram[i].load(std::memory_order_relaxed);
+      }
+    }
+    return metrics;
+  }
+};
+
+void BenchmarkAsyncMediator()
+{
+  constexpr size_t kProducers = 4;
+  constexpr size_t kEventsPerProducer = 250000;
+  const EventId tick = Events().Intern("bus.tick");
+  for (size_t threads : {1, 2, 4})
+  {
+    std::atomic<uint64_t> handled{0};
+    AsyncMediator bus(threads);
+    bus.On(tick, [&handled](BaseComponent *) { handled.fetch_add(1, std::memory_order_relaxed); });
+    std::vector<Component1> senders(kProducers);
+    for (size_t p = 0; p < kProducers; ++p)
+    {
+      bus.Pin(&senders[p], p);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < kProducers; ++p)
+    {
+      producers.emplace_back([&bus, &senders, p, tick]
+      {
+        for (size_t i = 0; i < kEventsPerProducer; ++i)
+        {
+          bus.Notify(&senders[p], tick);
+        }
+      });
+    }
+    for (std::thread &producer : producers)
+    {
+      producer.join();
+    }
+    bool flushed = bus.Flush(std::chrono::seconds(10));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    BusMetrics metrics = bus.Metrics();
+    std::cout << threads << " dispatcher(s): " << static_cast<uint64_t>(metrics.dispatched / seconds)
+              << " events/s, max depth " << metrics.max_depth << ", latency p50 < "
+              << metrics.LatencyPercentileNs(0.5) << " ns, p99 < " << metrics.LatencyPercentileNs(0.99) << " ns"
+              << (flushed && handled == kProducers * kEventsPerProducer ? "" : " (lost events)") << "\n";
+  }
+}
+
 /**
  * Client code.
  */
@@ -121,8 +651,78 @@ void ClientCode()
   delete mediator;
 }
 
+/**
+ * The same collaboration wired through a RoutedMediator.
+ */
+void RoutedClientCode()
+{
+  Component1 c1;
+  Component2 c2;
+  RoutedMediator mediator;
+  c1.set_mediator(&mediator);
+  c2.set_mediator(&mediator);
+  mediator.On(kEventA, [&c2](BaseComponent *)
+  {
+    std::cout << "Mediator reacts on A and triggers following operations:\n";
+    c2.DoC();
+  });
+  mediator.On(kEventD, [&c1, &c2](BaseComponent *)
+  {
+    std::cout << "Mediator reacts on D and triggers following operations:\n";
+    c1.DoB();
+    c2.DoC();
+  });
+  std::cout << "Client triggers operation A.\n";
+  c1.DoA();
+  std::cout << "\n";
+  std::cout << "Client triggers operation D.\n";
+  c2.DoD();
+}
+
+/**
+ * The same collaboration on an AsyncMediator with each component pinned to
+ * its own dispatcher. Reactions now run there instead of inside DoA and DoD.
+ */
+void AsyncClientCode()
+{
+  Component1 c1;
+  Component2 c2;
+  AsyncMediator mediator(2);
+  c1.set_mediator(&mediator);
+  c2.set_mediator(&mediator);
+  mediator.Pin(&c1, 0);
+  mediator.Pin(&c2, 1);
+  mediator.On(kEventA, [&c2](BaseComponent *)
+  {
+    std::cout << "Mediator reacts on A and triggers following operations:\n";
+    c2.DoC();
+  });
+  mediator.On(kEventD, [&c1, &c2](BaseComponent *)
+  {
+    std::cout << "Mediator reacts on D and triggers following operations:\n";
+    c1.DoB();
+    c2.DoC();
+  });
+  std::cout << "Client triggers operation A.\n";
+  c1.DoA();
+  mediator.Flush(std::chrono::seconds(1));
+  std::cout << "\n";
+  std::cout << "Client triggers operation D.\n";
+  c2.DoD();
+  mediator.Flush(std::chrono::seconds(1));
+  std::cout << "Mediator dispatched " << mediator.Metrics().dispatched << " events.\n";
+}
+
 int main() 
 {
   ClientCode();
+  std::cout << "\n";
+  RoutedClientCode();
+  std::cout << "\n";
+  BenchmarkMediators();
+  std::cout << "\n";
+  AsyncClientCode();
+  std::cout << "\n";
+  BenchmarkAsyncMediator();
   return 0;
 }
@@ -11,9 +11,20 @@
  * the same thing.
  */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <thread>
+#include <vector>
 
 class IObserver 
 {
@@ -40,7 +51,7 @@ class Subject : public ISubject
  public:
   virtual ~Subject() 
   {
-    std::cout << "Goodbye, I was the Subject;
+    std::cout << "Goodbye, I was the Subject.\n";
   }
 
   /**
@@ -71,7 +82,7 @@ class Subject : public ISubject
   }
   void HowManyObserver() 
   {
-    std::cout << "There are " << list_observer_.size() << "
+    std::cout << "There are " << list_observer_.size() << " observers in the list.\n";
   }
 
   /**
@@ -92,13 +103,517 @@ class Subject : public ISubject
   std::string message_;
 };
 
+/**
+ * A thread-safe publisher for large subscriber sets. Subscribers are kept in a
+ * contiguous, immutable snapshot that is replaced as a whole (copy-on-write)
+ * whenever someone attaches or detaches. Notify only loads the current
+ * snapshot and walks it, so it never waits for Attach/Detach and never sees a
+ * half-modified list.
+ *
+ * Readers take no lock. Before loading the snapshot, a reader counts itself
+ * in the current epoch, in one of several cache-line-sized counters picked
+ * per thread, so concurrent publishers rarely touch the same line. Writers
+ * serialize among themselves on a mutex and never wait for readers: a
+ * replaced snapshot is retired, and freed by a later writer once no reader
+ * that could have loaded it is left (see Replace).
+ */
+class ConcurrentSubject : public ISubject 
+{
+ public:
+  using Snapshot = std::vector<IObserver *>;
+
+  ConcurrentSubject() : observers_(new Snapshot())
+  {
+  }
+  ConcurrentSubject(const ConcurrentSubject &) = delete;
+  ConcurrentSubject &operator=(const ConcurrentSubject &) = delete;
+  ~ConcurrentSubject()
+  {
+    delete observers_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Subscription control methods. They copy the current snapshot, modify the
+   * copy and publish it, so their cost is O(n).
+   */
+  void Attach(IObserver *observer) override
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto next = std::make_unique<Snapshot>(*observers_.load(std::memory_order_relaxed));
+    next->push_back(observer);
+    Replace(std::move(next));
+  }
+  void Detach(IObserver *observer) override 
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto next = std::make_unique<Snapshot>(*observers_.load(std::memory_order_relaxed));
+    std::erase(*next, observer);
+    Replace(std::move(next));
+  }
+
+  /**
+   * Re-delivers the last message created through CreateMessage.
+   */
+  void Notify() override 
+  {
+    Publish(message_);
+  }
+
+  /**
+   * Delivers one message to every subscriber of the current snapshot.
+   */
+  void Publish(const std::string &message) const
+  {
+    ReadGuard guard(*this);
+    for (IObserver *observer : *guard.observers) {
+      observer->Update(message);
+    }
+  }
+
+  /**
+   * Delivers many messages in one pass: each subscriber receives the whole
+   * batch in order before the next one is visited, so the snapshot is loaded
+   * once and every subscriber's state stays hot in cache for the batch.
+   */
+  void NotifyBatch(std::span<const std::string> messages) const
+  {
+    ReadGuard guard(*this);
+    for (IObserver *observer : *guard.observers) {
+      for (const std::string &message : messages) {
+        observer->Update(message);
+      }
+    }
+  }
+
+  /**
+   * Unlike Subject::CreateMessage this is meant for a single publishing
+   * thread; concurrent publishers should call Publish directly.
+   */
+  void CreateMessage(std::string message = "Empty") 
+  {
+    this->message_ = std::move(message);
+    Notify();
+  }
+
+  size_t HowManyObserver() const
+  {
+    ReadGuard guard(*this);
+    return guard.observers->size();
+  }
+
+ private:
+  static constexpr size_t kReaderSlots = 16;
+
+  struct alignas(64) ReaderCount {
+    std::atomic<size_t> value{0};
+  };
+
+  static size_t ReaderSlot()
+  {
+    static std::atomic<size_t> next_slot{0};
+    thread_local const size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed) % kReaderSlots;
+    return slot;
+  }
+
+  /**
+   * Counts the calling thread as a reader of the current epoch for as long as
+   * it lives. The epoch is re-checked after counting in: if a writer flipped it
+   * in between, the writer may not have seen this reader, so it tries again.
+   */
+  struct ReadGuard {
+    explicit ReadGuard(const ConcurrentSubject &subject)
+    {
+      const size_t slot = ReaderSlot();
+      for (;;) {
+        const unsigned epoch = subject.epoch_.load(std::memory_order_seq_cst);
+        count = &subject.readers_[epoch][slot].value;
+        count->fetch_add(1, std::memory_order_seq_cst);
+        if (subject.epoch_.load(std::memory_order_seq_cst) == epoch) {
+          break;
+        }
+        count->fetch_sub(1, std::memory_order_release);
+      }
+      observers = subject.observers_.load(std::memory_order_seq_cst);
+    }
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+    ~ReadGuard()
+    {
+      count->fetch_sub(1, std::memory_order_release);
+    }
+
+    std::atomic<size_t> *count;
+    const Snapshot *observers;
+  };
+
+  /**
+   * Publishes `next` and retires the previous snapshot. Readers of the
+   * snapshots retired before the last epoch flip are all counted in the other
+   * epoch, since new readers only join the current one. Once that epoch has
+   * no readers left, those snapshots are freed and the epoch flips again;
+   * while it has, retired snapshots just accumulate. Called with
+   * write_mutex_ held.
+   */
+  void Replace(std::unique_ptr<Snapshot> next)
+  {
+    retiring_.emplace_back(observers_.exchange(next.release(), std::memory_order_seq_cst));
+    const unsigned epoch = epoch_.load(std::memory_order_relaxed);
+    for (const ReaderCount &count : readers_[epoch ^ 1u]) {
+      if (count.value.load(std::memory_order_seq_cst) != 0) {
+        return;
+      }
+    }
+    retired_ = std::move(retiring_);
+    retiring_.clear();
+    epoch_.store(epoch ^ 1u, std::memory_order_seq_cst);
+  }
+
+  std::atomic<const Snapshot *> observers_;
+  // Replaced since the last epoch flip, and before it.
+  std::vector<std::unique_ptr<const Snapshot>> retiring_;
+  std::vector<std::unique_ptr<const Snapshot>> retired_;
+  std::atomic<unsigned> epoch_{0};
+  mutable std::array<std::array<ReaderCount, kReaderSlots>, 2> readers_;
+  std::mutex write_mutex_;
+  std::string message_;
+};
+
+/**
+ * What an asynchronous subscription does when its queue is full.
+ */
+enum class BackpressurePolicy 
+{
+  Block,          // The publisher waits until the subscriber catches up.
+  DropOldest,     // The oldest pending message is discarded.
+  CoalesceLatest  // The newest pending message is replaced by the incoming one.
+};
+
+/**
+ * Delivery latency is bucketed by powers of two in microseconds: bucket i
+ * counts deliveries that took [2^i, 2^(i+1)) us, bucket 0 also holds < 1 us.
+ */
+constexpr size_t kLatencyBuckets = 24;
+
+struct SubscriptionStats 
+{
+  size_t depth = 0;
+  size_t capacity = 0;
+  uint64_t delivered = 0;
+  uint64_t dropped = 0;
+  uint64_t coalesced = 0;
+  std::array<uint64_t, kLatencyBuckets> latency_histogram{};
+};
+
+/**
+ * A publisher that never runs Update on its own thread. Each subscriber gets a
+ * bounded ring buffer of pending messages, and a pool of workers drains them.
+ * A subscription is handed to at most one worker at a time, so every
+ * subscriber still sees its messages in publication order, while a slow
+ * subscriber only delays itself.
+ */
+class AsyncSubject : public ISubject 
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct Pending 
+  {
+    std::string message;
+    Clock::time_point enqueued;
+  };
+
+  struct Subscription 
+  {
+    Subscription(IObserver *observer, size_t capacity, BackpressurePolicy policy)
+        : observer(observer), policy(policy), ring(std::max<size_t>(capacity, 1))
+    {
+    }
+
+    IObserver *observer;
+    BackpressurePolicy policy;
+    std::vector<Pending> ring;
+    size_t head = 0;
+    size_t size = 0;
+    bool scheduled = false;
+    bool delivering = false;
+    bool detached = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;
+    uint64_t coalesced = 0;
+    std::array<uint64_t, kLatencyBuckets> latency_histogram{};
+  };
+
+ public:
+  explicit AsyncSubject(size_t worker_count = std::max(1u, std::thread::hardware_concurrency()),
+                        size_t default_capacity = 1024,
+                        BackpressurePolicy default_policy = BackpressurePolicy::Block)
+      : default_capacity_(default_capacity), default_policy_(default_policy)
+  {
+    for (size_t i = 0; i < worker_count; ++i) {
+      workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  /**
+   * Everything already published is delivered before the workers stop.
+   */
+  virtual ~AsyncSubject() 
+  {
+    Flush();
+    {
+      std::lock_guard<std::mutex> lock(ready_mutex_);
+      stopping_ = true;
+    }
+    ready_changed_.notify_all();
+    for (std::thread &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void Attach(IObserver *observer) override
+  {
+    Subscribe(observer, default_capacity_, default_policy_);
+  }
+  void Subscribe(IObserver *observer, size_t capacity, BackpressurePolicy policy)
+  {
+    auto subscription = std::make_shared<Subscription>(observer, capacity, policy);
+    std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+    subscriptions_.push_back(std::move(subscription));
+  }
+
+  /**
+   * Pending messages of the subscriber are discarded. When Detach returns no
+   * worker is inside its Update any more, so the observer can be destroyed.
+   */
+  void Detach(IObserver *observer) override 
+  {
+    std::shared_ptr<Subscription> subscription;
+    {
+      std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+      auto it = std::find_if(subscriptions_.begin(), subscriptions_.end(),
+                             [observer](const auto &s) { return s->observer == observer; });
+      if (it == subscriptions_.end()) {
+        return;
+      }
+      subscription = std::move(*it);
+      subscriptions_.erase(it);
+    }
+    std::unique_lock<std::mutex> lock(subscription->mutex);
+    subscription->detached = true;
+    const size_t discarded = subscription->size;
+    subscription->size = 0;
+    subscription->changed.notify_all();
+    subscription->changed.wait(lock, [&] { return !subscription->delivering; });
+    lock.unlock();
+    Settle(discarded);
+  }
+
+  void Notify() override 
+  {
+    Publish(message_);
+  }
+
+  /**
+   * Enqueues the message for every subscriber and returns without waiting
+   * for delivery, unless a Block subscription is full.
+   */
+  void Publish(const std::string &message)
+  {
+    std::vector<std::shared_ptr<Subscription>> subscriptions;
+    {
+      std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+      subscriptions = subscriptions_;
+    }
+    const Clock::time_point now = Clock::now();
+    for (const std::shared_ptr<Subscription> &subscription : subscriptions) {
+      Enqueue(subscription, message, now);
+    }
+  }
+
+  void CreateMessage(std::string message = "Empty") 
+  {
+    this->message_ = std::move(message);
+    Notify();
+  }
+
+  /**
+   * Waits until every message published so far has been delivered or dropped.
+   */
+  void Flush()
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    settled_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+  SubscriptionStats Stats(IObserver *observer) const
+  {
+    SubscriptionStats stats;
+    std::shared_ptr<Subscription> subscription;
+    {
+      std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+      for (const auto &s : subscriptions_) {
+        if (s->observer == observer) {
+          subscription = s;
+        }
+      }
+    }
+    if (!subscription) {
+      return stats;
+    }
+    std::lock_guard<std::mutex> lock(subscription->mutex);
+    stats.depth = subscription->size;
+    stats.capacity = subscription->ring.size();
+    stats.delivered = subscription->delivered;
+    stats.dropped = subscription->dropped;
+    stats.coalesced = subscription->coalesced;
+    stats.latency_histogram = subscription->latency_histogram;
+    return stats;
+  }
+
+ private:
+  void Enqueue(const std::shared_ptr<Subscription> &subscription, const std::string &message, Clock::time_point now)
+  {
+    std::unique_lock<std::mutex> lock(subscription->mutex);
+    const size_t capacity = subscription->ring.size();
+    if (subscription->size == capacity && !subscription->detached) {
+      switch (subscription->policy) {
+        case BackpressurePolicy::Block:
+          subscription->changed.wait(lock, [&] { return subscription->size < capacity || subscription->detached; });
+          break;
+        case BackpressurePolicy::DropOldest:
+          subscription->head = (subscription->head + 1) % capacity;
+          --subscription->size;
+          ++subscription->dropped;
+          Settle(1);
+          break;
+        case BackpressurePolicy::CoalesceLatest: {
+          Pending &newest = subscription->ring[(subscription->head + subscription->size - 1) % capacity];
+          newest.message = message;
+          newest.enqueued = now;
+          ++subscription->coalesced;
+          return;
+        }
+      }
+    }
+    if (subscription->detached) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+      ++pending_;
+    }
+    Pending &slot = subscription->ring[(subscription->head + subscription->size) % capacity];
+    slot.message = message;
+    slot.enqueued = now;
+    ++subscription->size;
+    if (!subscription->scheduled) {
+      subscription->scheduled = true;
+      lock.unlock();
+      Schedule(subscription);
+    }
+  }
+
+  void Schedule(std::shared_ptr<Subscription> subscription)
+  {
+    {
+      std::lock_guard<std::mutex> lock(ready_mutex_);
+      ready_.push_back(std::move(subscription));
+    }
+    ready_changed_.notify_one();
+  }
+
+  void Settle(size_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_ -= count;
+    if (pending_ == 0) {
+      settled_.notify_all();
+    }
+  }
+
+  /**
+   * A worker delivers a bounded slice of one subscription's queue and then
+   * puts it back at the end of the ready queue, so a busy subscriber cannot
+   * starve the others.
+   */
+  void WorkerLoop()
+  {
+    constexpr size_t kSlice = 64;
+    for (;;) {
+      std::shared_ptr<Subscription> subscription;
+      {
+        std::unique_lock<std::mutex> lock(ready_mutex_);
+        ready_changed_.wait(lock, [this] { return stopping_ || !ready_.empty(); });
+        if (ready_.empty()) {
+          return;
+        }
+        subscription = std::move(ready_.front());
+        ready_.pop_front();
+      }
+
+      std::unique_lock<std::mutex> lock(subscription->mutex);
+      for (size_t n = 0; n < kSlice && subscription->size > 0; ++n) {
+        Pending pending = std::move(subscription->ring[subscription->head]);
+        subscription->head = (subscription->head + 1) % subscription->ring.size();
+        --subscription->size;
+        subscription->delivering = true;
+        subscription->changed.notify_all();
+        lock.unlock();
+
+        subscription->observer->Update(pending.message);
+        const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pending.enqueued).count();
+        Settle(1);
+
+        lock.lock();
+        subscription->delivering = false;
+        ++subscription->delivered;
+        size_t bucket = 0;
+        while (bucket + 1 < kLatencyBuckets && (uint64_t{1} << (bucket + 1)) <= static_cast<uint64_t>(micros)) {
+          ++bucket;
+        }
+        ++subscription->latency_histogram[bucket];
+        if (subscription->detached) {
+          subscription->changed.notify_all();
+        }
+      }
+      if (subscription->size > 0 && !subscription->detached) {
+        lock.unlock();
+        Schedule(std::move(subscription));
+      } else {
+        subscription->scheduled = false;
+      }
+    }
+  }
+
+  const size_t default_capacity_;
+  const BackpressurePolicy default_policy_;
+  mutable std::mutex subscriptions_mutex_;
+  std::vector<std::shared_ptr<Subscription>> subscriptions_;
+
+  std::mutex ready_mutex_;
+  std::condition_variable ready_changed_;
+  std::deque<std::shared_ptr<Subscription>> ready_;
+  bool stopping_ = false;
+
+  std::mutex pending_mutex_;
+  std::condition_variable settled_;
+  size_t pending_ = 0;
+
+  std::vector<std::thread> workers_;
+  std::string message_;
+};
+
 class Observer : public IObserver 
 {
  public:
   Observer(Subject &subject) : subject_(subject) 
   {
     this->subject_.Attach(this);
-    std::cout << "Hi, I'm the Observer \"" << ++Observer::static_number_ << "\".\n"
+    std::cout << "Hi, I'm the Observer \"" << ++Observer::static_number_ << "\".\n";
     this->number_ = Observer::static_number_;
   }
   virtual ~Observer() 
@@ -114,11 +629,11 @@ class Observer : public IObserver
   void RemoveMeFromTheList()
   {
     subject_.Detach(this);
-    std::cout << "Observer \" << number_ << "\" removed from the list.\n"
+    std::cout << "Observer \"" << number_ << "\" removed from the list.\n";
   }
   void PrintInfo() 
   {
-    std::cout << "Observer \" << this->number_ << "\": a new message is available --> " << this->message_from_subject_ << "\n";
+    std::cout << "Observer \"" << this->number_ << "\": a new message is available --> " << this->message_from_subject_ << "\n";
   }
 
  private:
@@ -139,8 +654,8 @@ void ClientCode()
   Observer *observer4;
   Observer *observer5;
 
-  Observer5; Observer->CreateMessage("Hello World! :D");
-  Observer3->RemoveMeFromTheList();
+  subject->CreateMessage("Hello World! :D");
+  observer3->RemoveMeFromTheList();
 
   subject->CreateMessage("The weather is hot today! :p");
   observer4 = new Observer(*subject);
@@ -148,7 +663,7 @@ void ClientCode()
   observer2->RemoveMeFromTheList();
   observer5 = new Observer(*subject);
 
-  observer->CreateMessage("My new car is great! ;)");
+  subject->CreateMessage("My new car is great! ;)");
   observer5->RemoveMeFromTheList();
 
   observer4->RemoveMeFromTheList();
@@ -162,8 +677,134 @@ void ClientCode()
   delete subject;
 }
 
+/**
+ * A subscriber that only counts messages, so the benchmark measures the cost
+ * of the fan-out itself rather than the cost of printing.
+ */
+class CountingObserver : public IObserver 
+{
+ public:
+  void Update(const std::string &message_from_subject) override 
+  {
+    received_ += message_from_subject.size();
+  }
+  size_t received() const
+  {
+    return received_;
+  }
+
+ private:
+  size_t received_ = 0;
+};
+
+/**
+ * Compares the list-based Subject with the ConcurrentSubject snapshot at
+ * several subscriber counts. Note that Subject::Notify also prints the number
+ * of observers on every call, which is part of what is being measured.
+ */
+void BenchmarkNotify() 
+{
+  using Clock = std::chrono::steady_clock;
+  const std::vector<std::string> batch(64, "benchmark message");
+
+  for (size_t count : {size_t{10}, size_t{1000}, size_t{100000}}) {
+    std::vector<CountingObserver> observers(count);
+    const size_t rounds = 1000000 / count + 1;
+
+    Subject subject;
+    ConcurrentSubject concurrent;
+    for (CountingObserver &observer : observers) {
+      subject.Attach(&observer);
+      concurrent.Attach(&observer);
+    }
+
+    // Subject::Notify reports the observer count on every call; keep that
+    // out of the output, though formatting it is still part of its cost.
+    std::cout.setstate(std::ios::failbit);
+    auto start = Clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+      subject.CreateMessage("benchmark message");
+    }
+    const auto list_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    std::cout.clear();
+
+    start = Clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+      concurrent.Publish("benchmark message");
+    }
+    const auto snapshot_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+    const size_t batch_rounds = rounds / batch.size() + 1;
+    start = Clock::now();
+    for (size_t i = 0; i < batch_rounds; ++i) {
+      concurrent.NotifyBatch(batch);
+    }
+    const auto batch_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+    const double deliveries = static_cast<double>(rounds * count);
+    const double batch_deliveries = static_cast<double>(batch_rounds * batch.size() * count);
+    std::cout << "\n" << count << " observers: list " << list_ns / deliveries
+              << " ns/update, snapshot " << snapshot_ns / deliveries
+              << " ns/update, batched " << batch_ns / batch_deliveries << " ns/update\n";
+  }
+}
+
+/**
+ * A deliberately slow subscriber next to a fast one: with AsyncSubject the
+ * publisher is not held back, and the stats show where messages piled up.
+ */
+class SlowObserver : public CountingObserver 
+{
+ public:
+  void Update(const std::string &message_from_subject) override 
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    CountingObserver::Update(message_from_subject);
+  }
+};
+
+void PrintStats(const char *name, const SubscriptionStats &stats) 
+{
+  std::cout << name << ": depth " << stats.depth << "/" << stats.capacity << ", delivered " << stats.delivered
+            << ", dropped " << stats.dropped << ", coalesced " << stats.coalesced << ", latency (us, log2 buckets):";
+  for (size_t i = 0; i < kLatencyBuckets; ++i) {
+    if (stats.latency_histogram[i] != 0) {
+      std::cout << " [" << (i == 0 ? 0 : uint64_t{1} << i) << "+]=" << stats.latency_histogram[i];
+    }
+  }
+  std::cout << "\n";
+}
+
+void AsyncClientCode() 
+{
+  SlowObserver slow;
+  CountingObserver fast;
+  CountingObserver latest;
+  AsyncSubject subject(2);
+  subject.Subscribe(&slow, 16, BackpressurePolicy::DropOldest);
+  subject.Subscribe(&fast, 1024, BackpressurePolicy::Block);
+  subject.Subscribe(&latest, 1, BackpressurePolicy::CoalesceLatest);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 1000; ++i) {
+    subject.CreateMessage("tick " + std::to_string(i));
+  }
+  const auto publish_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "\nAsyncSubject: published 1000 messages in " << publish_us << " us\n";
+  PrintStats("slow/drop-oldest", subject.Stats(&slow));
+  subject.Flush();
+  PrintStats("slow/drop-oldest", subject.Stats(&slow));
+  PrintStats("fast/block", subject.Stats(&fast));
+  PrintStats("latest/coalesce", subject.Stats(&latest));
+  subject.Detach(&slow);
+  subject.Detach(&fast);
+  subject.Detach(&latest);
+}
+
 int main() 
 {
   ClientCode();
+  BenchmarkNotify();
+  AsyncClientCode();
   return 0;
 }
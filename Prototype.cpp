@@ -1,3 +1,19 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "AllocationCounter.h"
+
 using std::string;
 
 // Pattern Prototype
@@ -7,17 +23,84 @@ using std::string;
 
 enum Type {
   PROTOTYPE_1 = 0,
-  PROTOTYPE_2
+  PROTOTYPE_2,
+  PROTOTYPE_COUNT
+};
+
+/**
+ * A copy-on-write value: copies share one block and bump an atomic reference
+ * count, and the first Mutable() on a shared copy detaches it. Distinct Cow
+ * objects sharing a block may be used from different threads; a single Cow
+ * object must not be mutated concurrently.
+ */
+template <typename T>
+class Cow {
+ private:
+  struct Block {
+    std::atomic<size_t> references;
+    T value;
+  };
+
+  Block *block_;
+
+  void Release() {
+    if (block_->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete block_;
+    }
+  }
+
+ public:
+  Cow() : Cow(T()) {}
+  Cow(T value) : block_(new Block{{1}, std::move(value)}) {}
+  Cow(const Cow &other) : block_(other.block_) {
+    block_->references.fetch_add(1, std::memory_order_relaxed);
+  }
+  Cow &operator=(const Cow &other) {
+    Cow copy(other);
+    std::swap(block_, copy.block_);
+    return *this;
+  }
+  ~Cow() { Release(); }
+
+  const T &operator*() const { return block_->value; }
+  const T *operator->() const { return &block_->value; }
+  bool shared() const { return block_->references.load(std::memory_order_acquire) != 1; }
+
+  T &Mutable() {
+    if (shared()) {
+      Block *copy = new Block{{1}, block_->value};
+      Release();
+      block_ = copy;
+    }
+    return block_->value;
+  }
+
+  /**
+   * Replaces the value without first copying a shared one.
+   */
+  void Reset(T value) {
+    if (shared()) {
+      Block *fresh = new Block{{1}, std::move(value)};
+      Release();
+      block_ = fresh;
+    } else {
+      block_->value = std::move(value);
+    }
+  }
 };
 
 /**
  * Example of a class that has the ability to clone. We'll see how
  * Cloning of field values of different types.
+ *
+ * The name is held copy-on-write: Clone() shares it with the prototype and
+ * only SetName() on a clone pays for a private copy. DeepClone() copies it
+ * eagerly, as Clone() used to.
  */
 
 class Prototype {
  protected:
-  string prototype_name_;
+  Cow<string> prototype_name_;
   float prototype_field_;
 
  public:
@@ -27,11 +110,25 @@ class Prototype {
 	  
   virtual ~Prototype() {}
   virtual Prototype *Clone() const = 0;
+  Prototype *DeepClone() const {
+    Prototype *copy = Clone();
+    copy->prototype_name_.Mutable();
+    return copy;
+  }
+  /**
+   * Clone into `storage`, which must hold at least Footprint() bytes aligned
+   * to alignof(std::max_align_t). The caller ends the clone's lifetime by
+   * calling its destructor, not delete.
+   */
+  virtual Prototype *CloneInto(void *storage) const = 0;
+  virtual size_t Footprint() const = 0;
+  const string &name() const { return *prototype_name_; }
+  void SetName(string prototype_name) { prototype_name_.Reset(std::move(prototype_name)); }
   virtual void Method(float prototype_field)
   {
     this->prototype_field_ = prototype_field;
 	
-    std::cout << "Call Method from " << prototype_name_
+    std::cout << "Call Method from " << *prototype_name_
 	<< " with field : " << prototype_field << std::endl;
   }
 };
@@ -62,6 +159,12 @@ class ConcretePrototype1 : public Prototype {
   Prototype *Clone() const override {
     return new ConcretePrototype1(*this);
   }
+  Prototype *CloneInto(void *storage) const override {
+    return new (storage) ConcretePrototype1(*this);
+  }
+  size_t Footprint() const override {
+    return sizeof(ConcretePrototype1);
+  }
 };
 
 class ConcretePrototype2 : public Prototype {
@@ -73,6 +176,8 @@ class ConcretePrototype2 : public Prototype {
       : Prototype(prototype_name), concrete_prototype_field2_(concrete_prototype_field) {}
 	  
   Prototype *Clone() const override { return new ConcretePrototype2(*this); }
+  Prototype *CloneInto(void *storage) const override { return new (storage) ConcretePrototype2(*this); }
+  size_t Footprint() const override { return sizeof(ConcretePrototype2); }
 };
 
 /**
@@ -110,6 +215,248 @@ class PrototypeFactory {
   }
 };
 
+/**
+ * Fixed-size slots for the clones of one prototype. Freed slots go on an
+ * intrusive free list and storage grows in doubling blocks, so once warm the
+ * pool never touches the heap. Not thread-safe.
+ */
+class PrototypePool {
+ private:
+  union Slot {
+    Slot *next;
+    alignas(std::max_align_t) unsigned char bytes[1];
+  };
+
+  size_t slot_size_ = 0;
+  size_t block_slots_ = 16;
+  Slot *free_ = nullptr;
+  std::vector<std::unique_ptr<unsigned char[]>> blocks_;
+
+  void Grow() {
+    blocks_.emplace_back(new unsigned char[slot_size_ * block_slots_]);
+    unsigned char *block = blocks_.back().get();
+    for (size_t i = 0; i < block_slots_; ++i) {
+      Slot *slot = reinterpret_cast<Slot *>(block + i * slot_size_);
+      slot->next = free_;
+      free_ = slot;
+    }
+    block_slots_ *= 2;
+  }
+
+ public:
+  explicit PrototypePool(size_t object_size = 0) { Resize(object_size); }
+  PrototypePool(const PrototypePool &) = delete;
+  PrototypePool &operator=(const PrototypePool &) = delete;
+
+  /**
+   * Only valid before the first Acquire.
+   */
+  void Resize(size_t object_size) {
+    constexpr size_t kAlign = alignof(std::max_align_t);
+    size_t size = object_size < sizeof(Slot) ? sizeof(Slot) : object_size;
+    slot_size_ = (size + kAlign - 1) / kAlign * kAlign;
+  }
+
+  void *Acquire() {
+    if (!free_) {
+      Grow();
+    }
+    Slot *slot = free_;
+    free_ = slot->next;
+    return slot;
+  }
+
+  void Release(void *storage) {
+    Slot *slot = static_cast<Slot *>(storage);
+    slot->next = free_;
+    free_ = slot;
+  }
+};
+
+/**
+ * Destroys a pooled clone and gives its slot back, so a PrototypeHandle
+ * cleans up after itself like any unique_ptr.
+ */
+struct PooledDeleter {
+  PrototypePool *pool = nullptr;
+  void operator()(Prototype *prototype) const {
+    prototype->~Prototype();
+    pool->Release(prototype);
+  }
+};
+
+using PrototypeHandle = std::unique_ptr<Prototype, PooledDeleter>;
+
+/**
+ * n clones of one prototype laid out back to back in a single block. The
+ * whole batch is destroyed and freed at once.
+ */
+class PrototypeBatch {
+ private:
+  struct Free {
+    void operator()(unsigned char *block) const { ::operator delete(block); }
+  };
+
+  std::unique_ptr<unsigned char, Free> block_;
+  size_t stride_ = 0;
+  size_t size_ = 0;
+
+ public:
+  PrototypeBatch() {}
+  PrototypeBatch(const Prototype &prototype, size_t n) {
+    constexpr size_t kAlign = alignof(std::max_align_t);
+    stride_ = (prototype.Footprint() + kAlign - 1) / kAlign * kAlign;
+    if (n == 0) {
+      return;
+    }
+    block_.reset(static_cast<unsigned char *>(::operator new(stride_ * n)));
+    for (; size_ < n; ++size_) {
+      prototype.CloneInto(block_.get() + size_ * stride_);
+    }
+  }
+  PrototypeBatch(PrototypeBatch &&other) noexcept
+      : block_(std::move(other.block_)), stride_(other.stride_), size_(std::exchange(other.size_, 0)) {}
+  PrototypeBatch &operator=(PrototypeBatch &&other) noexcept {
+    if (this != &other) {
+      Clear();
+      block_ = std::move(other.block_);
+      stride_ = other.stride_;
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+  ~PrototypeBatch() { Clear(); }
+
+  void Clear() {
+    for (size_t i = 0; i < size_; ++i) {
+      (*this)[i].~Prototype();
+    }
+    size_ = 0;
+    block_.reset();
+  }
+
+  size_t size() const { return size_; }
+  Prototype &operator[](size_t i) {
+    return *std::launder(reinterpret_cast<Prototype *>(block_.get() + i * stride_));
+  }
+};
+
+/**
+ * PrototypeFactory with the registry in an array indexed by Type and every
+ * clone placed in a per-type pool instead of its own heap allocation.
+ * Clones come back as RAII handles; they must not outlive the factory.
+ */
+class PooledPrototypeFactory {
+ private:
+  std::array<std::unique_ptr<Prototype>, PROTOTYPE_COUNT> prototypes_;
+  std::array<PrototypePool, PROTOTYPE_COUNT> pools_;
+
+ public:
+  PooledPrototypeFactory() {
+    prototypes_[Type::PROTOTYPE_1] = std::make_unique<ConcretePrototype1>("PROTOTYPE_1 ", 50.f);
+    prototypes_[Type::PROTOTYPE_2] = std::make_unique<ConcretePrototype2>("PROTOTYPE_2 ", 60.f);
+    for (size_t type = 0; type < PROTOTYPE_COUNT; ++type) {
+      pools_[type].Resize(prototypes_[type]->Footprint());
+    }
+  }
+
+  PrototypeHandle CreatePrototype(Type type) {
+    PrototypePool &pool = pools_[type];
+    void *storage = pool.Acquire();
+    return PrototypeHandle(prototypes_[type]->CloneInto(storage), PooledDeleter{&pool});
+  }
+
+  PrototypeBatch CreatePrototypes(Type type, size_t n) const {
+    return PrototypeBatch(*prototypes_[type], n);
+  }
+};
+
+void BenchmarkFactories() {
+  constexpr size_t kClones = 1000000;
+  constexpr size_t kBatch = 1000;
+  Prototype *volatile sink = nullptr;
+
+  auto report = [](const char *name, size_t allocations, std::chrono::steady_clock::time_point start) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << static_cast<double>(allocation_count - allocations) / kClones << " allocations/clone, "
+              << static_cast<uint64_t>(kClones / seconds) << " clones/s\n";
+  };
+
+  PrototypeFactory classic;
+  size_t allocations = allocation_count;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kClones; ++i) {
+    Prototype *prototype = classic.CreatePrototype(Type::PROTOTYPE_1);
+    sink = prototype;
+    delete prototype;
+  }
+  report("PrototypeFactory:                 ", allocations, start);
+
+  PooledPrototypeFactory pooled;
+  allocations = allocation_count;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kClones; ++i) {
+    PrototypeHandle prototype = pooled.CreatePrototype(Type::PROTOTYPE_1);
+    sink = prototype.get();
+  }
+  report("PooledPrototypeFactory (handles): ", allocations, start);
+
+  allocations = allocation_count;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kClones; i += kBatch) {
+    PrototypeBatch batch = pooled.CreatePrototypes(Type::PROTOTYPE_1, kBatch);
+    sink = &batch[kBatch - 1];
+  }
+  report("PooledPrototypeFactory (batches): ", allocations, start);
+  (void)sink;
+}
+
+/**
+ * Heap bytes per clone of a prototype with a long name, cloned eagerly and
+ * copy-on-write, and what the first write to a shared clone costs.
+ */
+void BenchmarkCopyOnWrite() {
+  constexpr size_t kClones = 100000;
+  ConcretePrototype1 prototype(string(256, 'p'), 50.f);
+  std::vector<std::unique_ptr<Prototype>> clones;
+  clones.reserve(kClones);
+
+  auto measure = [&](const char *name, auto clone) {
+    clones.clear();
+    size_t bytes = allocated_bytes;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kClones; ++i) {
+      clones.emplace_back(clone());
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << (allocated_bytes - bytes) / kClones << " bytes/clone, " << elapsed / kClones << " ns/clone\n";
+  };
+  measure("DeepClone:           ", [&] { return prototype.DeepClone(); });
+  measure("Clone (COW):         ", [&] { return prototype.Clone(); });
+
+  size_t bytes = allocated_bytes;
+  clones.front()->SetName("renamed");
+  std::cout << "First SetName on a shared clone: " << allocated_bytes - bytes << " bytes, "
+            << (prototype.name().size() == 256 ? "prototype unchanged" : "prototype modified (bug)") << "\n";
+
+  // Clones of the same prototype are created and destroyed on many threads.
+  clones.clear();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&prototype] {
+      for (int i = 0; i < 10000; ++i) {
+        std::unique_ptr<Prototype> clone(prototype.Clone());
+        if (i % 100 == 0) {
+          clone->SetName("private");
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
 void Client(PrototypeFactory &prototype_factory) {
   std::cout << "Let's create a Prototype 1\n";
 
@@ -132,5 +479,10 @@ int main() {
   Client(*prototype_factory);
   delete prototype_factory;
 
+  std::cout << "\n";
+  BenchmarkFactories();
+  std::cout << "\n";
+  BenchmarkCopyOnWrite();
+
   return 0;
 }
\ No newline at end of file
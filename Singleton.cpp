@@ -1,3 +1,11 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 /**
  * The Singleton class provides a `GetInstance' method, which behaves like an
  * alternate constructor and allows clients to get the same
@@ -16,7 +24,8 @@ protected:
     {
     }
 
-    static Singleton* singleton_;
+    static std::atomic<Singleton*> singleton_;
+    static std::mutex mutex_;
 
     std::string value_;
 
@@ -52,7 +61,8 @@ public:
     } 
 };
 
-Singleton* Singleton::singleton_= nullptr;;
+std::atomic<Singleton*> Singleton::singleton_{nullptr};
+std::mutex Singleton::mutex_;
 
 /**
  * Static methods should be defined outside the class.
@@ -63,10 +73,121 @@ Singleton *Singleton::GetInstance(const std::string& value)
      * This is a safer way to create an instance. instance = new Singleton is
      * dangeruous in case two instance threads wants to access at the same time
      */
-    if(singleton_==nullptr){
-        singleton_ = new Singleton(value);
+    /**
+     * Double-checked locking: once the instance exists every call is a single
+     * acquire load. Only the threads that race for the first access take the
+     * mutex, and the second check makes sure just one of them creates it.
+     */
+    Singleton* instance = singleton_.load(std::memory_order_acquire);
+    if(instance==nullptr){
+        std::lock_guard<std::mutex> lock(mutex_);
+        instance = singleton_.load(std::memory_order_relaxed);
+        if(instance==nullptr){
+            instance = new Singleton(value);
+            singleton_.store(instance, std::memory_order_release);
+        }
+    }
+    return instance;
+}
+
+/**
+ * The same idea as a reusable template for your own services. The first call
+ * to Instance constructs T from the given arguments; later arguments are
+ * ignored. The constructor of T may stay private if T befriends the holder.
+ */
+template <typename T>
+class SingletonHolder
+{
+public:
+    SingletonHolder() = delete;
+
+    template <typename... Args>
+    static T& Instance(Args&&... args)
+    {
+        T* instance = instance_.load(std::memory_order_acquire);
+        if(instance==nullptr){
+            std::call_once(once_, [&] {
+                instance_.store(new T(std::forward<Args>(args)...), std::memory_order_release);
+            });
+            instance = instance_.load(std::memory_order_acquire);
+        }
+        return *instance;
+    }
+
+private:
+    static inline std::atomic<T*> instance_{nullptr};
+    static inline std::once_flag once_;
+};
+
+/**
+ * A plain mutex-guarded singleton, kept only as the baseline for the
+ * benchmark below: every call pays for the lock.
+ */
+class MutexSingleton
+{
+public:
+    static MutexSingleton* GetInstance()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(instance_==nullptr){
+            instance_ = new MutexSingleton();
+        }
+        return instance_;
+    }
+
+private:
+    MutexSingleton() = default;
+
+    static inline MutexSingleton* instance_ = nullptr;
+    static inline std::mutex mutex_;
+};
+
+struct Service
+{
+    explicit Service(int id) : id_(id) {}
+    int id_;
+};
+
+/**
+ * Measures the per-call cost of GetInstance when all threads hammer it at
+ * once, for 1 to 64 threads.
+ */
+template <typename GetInstance>
+double NanosecondsPerCall(unsigned threads, GetInstance get_instance)
+{
+    constexpr int kCalls = 200000;
+    std::atomic<bool> go{false};
+    std::atomic<std::uintptr_t> sink{0};
+    std::vector<std::thread> pool;
+    for(unsigned t=0;t<threads;t++){
+        pool.emplace_back([&] {
+            while(!go.load(std::memory_order_acquire)){
+            }
+            std::uintptr_t local = 0;
+            for(int i=0;i<kCalls;i++){
+                local += reinterpret_cast<std::uintptr_t>(get_instance());
+            }
+            sink.fetch_add(local, std::memory_order_relaxed);
+        });
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for(std::thread& thread : pool){
+        thread.join();
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(elapsed) / (static_cast<double>(kCalls) * threads);
+}
+
+void BenchmarkGetInstance()
+{
+    std::cout << "\nthreads  double-checked  SingletonHolder  mutex  (ns/call)\n";
+    for(unsigned threads=1;threads<=64;threads*=2){
+        std::cout << threads << "  "
+                  << NanosecondsPerCall(threads, [] { return Singleton::GetInstance("BENCH"); }) << "  "
+                  << NanosecondsPerCall(threads, [] { return &SingletonHolder<Service>::Instance(42); }) << "  "
+                  << NanosecondsPerCall(threads, [] { return MutexSingleton::GetInstance(); }) << "\n";
     }
-    return singleton_;
 }
 
 void ThreadFoo(){
@@ -95,5 +216,7 @@ int main()
     t1.join();
     t2.join();
 
+    BenchmarkGetInstance();
+
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <span>
+#include <stdexcept>
+#include <thread>
 #include <typeinfo>
+#include <vector>
 /**
  * The base class States declares methods to implement all
  * Specific States, and also provides a backward reference to the object
@@ -103,11 +111,262 @@ void ConcreteStateA::Handle1() {
   }
 }
 
+/**
+ * The same machine in table-driven form. States and events are small enums,
+ * and the reaction to every (state, event) pair is one entry of a transition
+ * table built at compile time, so a transition is an array lookup with no
+ * allocation and no virtual call.
+ */
+enum class StateId : uint8_t { A, B, kCount };
+enum class Event : uint8_t { Request1, Request2, kCount };
+
+constexpr const char *StateName(StateId state) {
+  return state == StateId::A ? "ConcreteStateA" : "ConcreteStateB";
+}
+
+struct TransitionRule {
+  StateId from;
+  Event event;
+  StateId to;
+};
+
+using TransitionTable = std::array<std::array<StateId, static_cast<size_t>(Event::kCount)>,
+                                   static_cast<size_t>(StateId::kCount)>;
+
+/**
+ * Any (state, event) pair without a rule keeps the machine where it is.
+ */
+template <size_t N>
+constexpr TransitionTable MakeTransitionTable(const TransitionRule (&rules)[N]) {
+  TransitionTable table{};
+  for (size_t s = 0; s < table.size(); ++s) {
+    for (size_t e = 0; e < table[s].size(); ++e) {
+      table[s][e] = static_cast<StateId>(s);
+    }
+  }
+  for (const TransitionRule &rule : rules) {
+    table[static_cast<size_t>(rule.from)][static_cast<size_t>(rule.event)] = rule.to;
+  }
+  return table;
+}
+
+constexpr TransitionRule kRules[] = {
+    {StateId::A, Event::Request1, StateId::B},
+    {StateId::B, Event::Request2, StateId::A},
+};
+constexpr TransitionTable kTransitions = MakeTransitionTable(kRules);
+
+static_assert(kTransitions[static_cast<size_t>(StateId::A)][static_cast<size_t>(Event::Request2)] == StateId::A);
+
+/**
+ * Tracing is a policy: the default one is empty and inlines away completely,
+ * so an untraced machine pays nothing for it.
+ */
+struct NoTracing {
+  void OnTransition(StateId, Event, StateId) {
+  }
+};
+
+struct StreamTracing {
+  void OnTransition(StateId from, Event event, StateId to) {
+    std::cout << StateName(from) << " handles request" << (event == Event::Request1 ? 1 : 2) << ".\n";
+    if (from != to) {
+      std::cout << "Context: Transition to " << StateName(to) << ".\n";
+    }
+  }
+};
+
+template <typename Tracer = NoTracing>
+class TableContext {
+ public:
+  explicit TableContext(StateId state = StateId::A, Tracer tracer = Tracer()) : state_(state), tracer_(tracer) {
+  }
+  void Dispatch(Event event) {
+    const StateId next = kTransitions[static_cast<size_t>(this->state_)][static_cast<size_t>(event)];
+    this->tracer_.OnTransition(this->state_, event, next);
+    this->state_ = next;
+  }
+  void Request1() {
+    this->Dispatch(Event::Request1);
+  }
+  void Request2() {
+    this->Dispatch(Event::Request2);
+  }
+  StateId state() const {
+    return this->state_;
+  }
+
+ private:
+  StateId state_;
+  [[no_unique_address]] Tracer tracer_;
+};
+
+/**
+ * The state of many sessions at once: one byte per session instead of a
+ * Context with a heap-allocated State and a back-pointer. Events are applied
+ * to whole ranges of sessions. The table is flattened to 1-D so that every
+ * session is updated with the same branch-free lookup, whatever state it is
+ * in; because of that no grouping by state is needed and the loop
+ * vectorizes. Ranges can be split across threads since sessions are
+ * independent.
+ */
+class SessionTable {
+ public:
+  explicit SessionTable(size_t sessions, StateId initial = StateId::A) : states_(sessions, initial) {
+  }
+
+  size_t size() const {
+    return this->states_.size();
+  }
+  StateId state(size_t session) const {
+    return this->states_[session];
+  }
+  size_t MemoryBytes() const {
+    return this->states_.capacity() * sizeof(StateId);
+  }
+
+  /**
+   * Applies the same event to every session in [begin, end). Throws
+   * std::out_of_range if the range is reversed or runs past the last session.
+   */
+  void Apply(Event event, size_t begin, size_t end) {
+    if (begin > end || end > this->states_.size()) {
+      throw std::out_of_range("SessionTable::Apply: session range out of bounds");
+    }
+    // The column of the table for this event: next state indexed by current state.
+    std::array<StateId, static_cast<size_t>(StateId::kCount)> next;
+    for (size_t s = 0; s < next.size(); ++s) {
+      next[s] = kTransitions[s][static_cast<size_t>(event)];
+    }
+    StateId *states = this->states_.data();
+    for (size_t i = begin; i < end; ++i) {
+      states[i] = next[static_cast<size_t>(states[i])];
+    }
+  }
+
+  /**
+   * Applies events[i] to session begin + i, one event per session. Throws
+   * std::out_of_range if the events run past the last session.
+   */
+  void Apply(std::span<const Event> events, size_t begin) {
+    if (begin > this->states_.size() || events.size() > this->states_.size() - begin) {
+      throw std::out_of_range("SessionTable::Apply: more events than sessions");
+    }
+    StateId *states = this->states_.data() + begin;
+    for (size_t i = 0; i < events.size(); ++i) {
+      states[i] = kFlatTransitions[static_cast<size_t>(states[i]) * kEventCount + static_cast<size_t>(events[i])];
+    }
+  }
+
+  /**
+   * Applies one event per session for all sessions, split into contiguous
+   * shards that run on `threads` threads. Throws std::invalid_argument
+   * unless there is exactly one event per session.
+   */
+  void ApplyParallel(std::span<const Event> events, size_t threads) {
+    if (events.size() != this->states_.size()) {
+      throw std::invalid_argument("SessionTable::ApplyParallel: need one event per session");
+    }
+    threads = std::max<size_t>(1, std::min(threads, this->states_.size()));
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+      const size_t begin = this->states_.size() * t / threads;
+      const size_t end = this->states_.size() * (t + 1) / threads;
+      pool.emplace_back([this, events, begin, end] { this->Apply(events.subspan(begin, end - begin), begin); });
+    }
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+  }
+
+ private:
+  static constexpr size_t kEventCount = static_cast<size_t>(Event::kCount);
+  static constexpr std::array<StateId, static_cast<size_t>(StateId::kCount) * kEventCount> kFlatTransitions = [] {
+    std::array<StateId, static_cast<size_t>(StateId::kCount) * kEventCount> flat{};
+    for (size_t s = 0; s < kTransitions.size(); ++s) {
+      for (size_t e = 0; e < kEventCount; ++e) {
+        flat[s * kEventCount + e] = kTransitions[s][e];
+      }
+    }
+    return flat;
+  }();
+
+  std::vector<StateId> states_;
+};
+
+/**
+ * Applies rounds of one random event per session to ten million sessions,
+ * single-threaded and sharded over all cores.
+ */
+void BenchmarkSessionTable() {
+  constexpr size_t kSessions = 10000000;
+  constexpr size_t kRounds = 10;
+  SessionTable sessions(kSessions);
+  std::vector<Event> events(kSessions);
+  uint32_t seed = 777;
+  for (Event &event : events) {
+    seed = seed * 1664525u + 1013904223u;
+    event = (seed >> 16) & 1 ? Event::Request1 : Event::Request2;
+  }
+
+  const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  std::cout << "\nSessionTable: " << static_cast<double>(sessions.MemoryBytes()) / kSessions
+            << " bytes/session (a Context with its State takes " << sizeof(Context) + sizeof(ConcreteStateA)
+            << " bytes, and the State is a separate heap allocation)\n";
+  for (size_t threads = 1; threads <= cores; threads = threads < cores ? cores : cores + 1) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < kRounds; ++r) {
+      sessions.ApplyParallel(events, threads);
+      sessions.Apply(Event::Request2, 0, kSessions);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << threads << " thread(s): " << static_cast<size_t>(2 * kRounds * kSessions / seconds)
+              << " events/sec\n";
+  }
+}
+
+/**
+ * Sends the same random sequence of events to the classic Context (with
+ * std::cout muted) and to the untraced table machine.
+ */
+void BenchmarkTransitions() {
+  constexpr size_t kEvents = 2000000;
+  std::vector<Event> events(kEvents);
+  uint32_t seed = 12345;
+  for (Event &event : events) {
+    seed = seed * 1664525u + 1013904223u;
+    event = (seed >> 16) & 1 ? Event::Request1 : Event::Request2;
+  }
+
+  std::cout.setstate(std::ios::failbit);
+  Context *context = new Context(new ConcreteStateA);
+  auto start = std::chrono::steady_clock::now();
+  for (Event event : events) {
+    event == Event::Request1 ? context->Request1() : context->Request2();
+  }
+  const double classic_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  delete context;
+  std::cout.clear();
+
+  TableContext<> table;
+  size_t in_a = 0;
+  start = std::chrono::steady_clock::now();
+  for (Event event : events) {
+    table.Dispatch(event);
+    in_a += table.state() == StateId::A;
+  }
+  const double table_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "\nContext:      " << static_cast<size_t>(kEvents / classic_s) << " events/sec\n";
+  std::cout << "TableContext: " << static_cast<size_t>(kEvents / table_s) << " events/sec (" << in_a
+            << " ended in A)\n";
+}
+
 /**
  * Client code.
  */
 void ClientCode() {
-  Context *context = new Context(new ConcreteStateA;)
+  Context *context = new Context(new ConcreteStateA);
   context->Request1();
   context->Request2();
   delete context;
@@ -115,5 +374,13 @@ void ClientCode() {
 
 int main() {
   ClientCode();
+
+  std::cout << "\nThe table-driven machine with tracing switched on:\n";
+  TableContext<StreamTracing> traced;
+  traced.Request1();
+  traced.Request2();
+
+  BenchmarkTransitions();
+  BenchmarkSessionTable();
   return 0;
 }
@@ -1,3 +1,21 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
 /**
  * The Strategy interface declares operations common to all supported versions
  * of some algorithm.
@@ -9,8 +27,71 @@ class Strategy
 public:
     virtual ~Strategy() = default;
     virtual std::string doAlgorithm(std::string_view data) const = 0;
+    /**
+     * Writes the result into `out`, which must have room for data.size()
+     * bytes, instead of allocating a new string.
+     */
+    virtual void doAlgorithm(std::string_view data, char *out) const = 0;
 };
 
+/**
+ * Sorting kernels shared by the concrete strategies. They order bytes the
+ * same way std::sort orders `char`, so results are identical whatever the
+ * signedness of char.
+ */
+namespace kernels
+{
+/**
+ * The inputs are byte data with only 256 possible values, so a counting sort
+ * does it in two linear passes.
+ */
+template <bool Descending>
+void countingSort(std::string_view data, char *out)
+{
+    std::array<size_t, 256> counts{};
+    for (char c : data)
+    {
+        ++counts[static_cast<int>(c) - CHAR_MIN];
+    }
+    for (size_t n = 0; n < counts.size(); ++n)
+    {
+        const size_t bucket = Descending ? counts.size() - 1 - n : n;
+        if (counts[bucket])
+        {
+            std::memset(out, static_cast<int>(bucket) + CHAR_MIN, counts[bucket]);
+            out += counts[bucket];
+        }
+    }
+}
+
+/**
+ * Below this size the 256-entry histogram costs more than a comparison sort,
+ * which for short inputs is an insertion sort inside std::sort.
+ */
+constexpr size_t kCountingSortMin = 256;
+
+template <bool Descending>
+void sort(std::string_view data, char *out)
+{
+    if (data.size() < kCountingSortMin)
+    {
+        std::memcpy(out, data.data(), data.size());
+        if (Descending)
+        {
+            std::sort(out, out + data.size(), std::greater<>());
+        }
+        else
+        {
+            std::sort(out, out + data.size());
+        }
+    }
+    else
+    {
+        countingSort<Descending>(data, out);
+    }
+}
+} // namespace kernels
+
 /**
  * The context defines the interface of interest to the clients.
  */
@@ -60,7 +141,96 @@ public:
  * Specific Strategies implements the algorithm, following the  * basic interface
  * Strategies. This interface makes them interchangeable in  * the Context.
  */
-class ConcreteStrategyA : public Strategy
+class ConcreteStrategyA final : public Strategy
+{
+public:
+    std::string doAlgorithm(std::string_view data) const override
+    {
+        std::string result(data.size(), '\0');
+        doAlgorithm(data, result.data());
+
+        return result;
+    }
+    void doAlgorithm(std::string_view data, char *out) const override
+    {
+        kernels::sort<false>(data, out);
+    }
+};
+class ConcreteStrategyB final : public Strategy
+{
+public:
+    std::string doAlgorithm(std::string_view data) const override
+    {
+        std::string result(data.size(), '\0');
+        doAlgorithm(data, result.data());
+
+        return result;
+    }
+    void doAlgorithm(std::string_view data, char *out) const override
+    {
+        kernels::sort<true>(data, out);
+    }
+};
+
+/**
+ * When the strategy is known at compile time it can be a template parameter.
+ * The strategy is stored by value and, since the concrete classes are final,
+ * every call is resolved statically and can be inlined.
+ */
+template <typename ConcreteStrategy>
+class StaticContext
+{
+private:
+    ConcreteStrategy strategy_;
+
+public:
+    void doAlgorithm(std::string_view data, char *out) const
+    {
+        strategy_.doAlgorithm(data, out);
+    }
+};
+
+/**
+ * When it is chosen at runtime from a closed set, a std::variant keeps it
+ * without a heap allocation. The variant is visited once per batch, not once
+ * per item, so the loop inside runs with a statically known strategy.
+ */
+class VariantContext
+{
+public:
+    using AnyStrategy = std::variant<ConcreteStrategyA, ConcreteStrategyB>;
+
+private:
+    AnyStrategy strategy_;
+
+public:
+    explicit VariantContext(AnyStrategy strategy = ConcreteStrategyA()) : strategy_(strategy)
+    {
+    }
+    void set_strategy(AnyStrategy strategy)
+    {
+        strategy_ = strategy;
+    }
+    /**
+     * Processes every input of the batch; outs[i] must have room for
+     * inputs[i].size() bytes.
+     */
+    void doAlgorithm(std::span<const std::string_view> inputs, std::span<char *const> outs) const
+    {
+        std::visit([&](const auto &strategy) {
+            for (size_t i = 0; i < inputs.size(); ++i)
+            {
+                strategy.doAlgorithm(inputs[i], outs[i]);
+            }
+        }, strategy_);
+    }
+};
+/**
+ * Two more ways to sort ascending. They give the same result as
+ * ConcreteStrategyA but perform differently depending on the input size,
+ * which makes them candidates for the AdaptiveContext below.
+ */
+class ComparisonSortStrategy final : public Strategy
 {
 public:
     std::string doAlgorithm(std::string_view data) const override
@@ -70,17 +240,203 @@ public:
 
         return result;
     }
+    void doAlgorithm(std::string_view data, char *out) const override
+    {
+        std::memcpy(out, data.data(), data.size());
+        std::sort(out, out + data.size());
+    }
 };
-class ConcreteStrategyB : public Strategy
+class CountingSortStrategy final : public Strategy
 {
+public:
     std::string doAlgorithm(std::string_view data) const override
     {
-        std::string result(data);
-        std::sort(std::begin(result), std::end(result), std::greater<>());
+        std::string result(data.size(), '\0');
+        doAlgorithm(data, result.data());
 
         return result;
     }
+    void doAlgorithm(std::string_view data, char *out) const override
+    {
+        kernels::countingSort<false>(data, out);
+    }
 };
+
+/**
+ * A context that picks the strategy itself. All registered strategies must
+ * be interchangeable, i.e. produce the same result. Inputs are grouped into
+ * power-of-two size buckets. In each bucket the context first runs every
+ * strategy a few times on real requests and times them. It then uses the one
+ * with the lowest mean cost per call, and after `reevaluate_every` calls it
+ * samples all of them again, in case the data has changed. Like Context it is
+ * meant to be used from one thread.
+ */
+class AdaptiveContext
+{
+public:
+    struct StrategyCost
+    {
+        std::string name;
+        size_t samples = 0;
+        double mean_ns = 0;
+    };
+    struct BucketStats
+    {
+        size_t min_size = 0;
+        size_t max_size = 0;
+        size_t calls = 0;
+        std::string chosen;
+        std::vector<StrategyCost> costs;
+    };
+
+private:
+    struct Bucket
+    {
+        std::vector<StrategyCost> costs;
+        size_t calls = 0;
+        size_t calls_since_evaluation = 0;
+        size_t chosen = 0;
+        bool exploring = true;
+    };
+
+    std::vector<std::pair<std::string, std::unique_ptr<Strategy>>> strategies_;
+    std::vector<Bucket> buckets_;
+    size_t samples_per_strategy_;
+    size_t reevaluate_every_;
+
+    static size_t bucketIndex(size_t size)
+    {
+        return size == 0 ? 0 : std::bit_width(size) - 1;
+    }
+
+    Bucket &bucketFor(size_t size)
+    {
+        const size_t index = bucketIndex(size);
+        if (buckets_.size() <= index)
+        {
+            buckets_.resize(index + 1);
+        }
+        Bucket &bucket = buckets_[index];
+        if (bucket.costs.size() != strategies_.size())
+        {
+            bucket.costs.resize(strategies_.size());
+            bucket.exploring = true;
+        }
+        return bucket;
+    }
+
+    /**
+     * While exploring, the strategy with the fewest samples runs next; once
+     * each has enough, the cheapest one is chosen.
+     */
+    size_t pick(Bucket &bucket)
+    {
+        if (bucket.exploring)
+        {
+            size_t next = 0;
+            for (size_t i = 1; i < bucket.costs.size(); ++i)
+            {
+                if (bucket.costs[i].samples < bucket.costs[next].samples)
+                {
+                    next = i;
+                }
+            }
+            if (bucket.costs[next].samples < samples_per_strategy_)
+            {
+                return next;
+            }
+            bucket.exploring = false;
+            bucket.calls_since_evaluation = 0;
+            bucket.chosen = 0;
+            for (size_t i = 1; i < bucket.costs.size(); ++i)
+            {
+                if (bucket.costs[i].mean_ns < bucket.costs[bucket.chosen].mean_ns)
+                {
+                    bucket.chosen = i;
+                }
+            }
+        }
+        else if (++bucket.calls_since_evaluation >= reevaluate_every_)
+        {
+            for (StrategyCost &cost : bucket.costs)
+            {
+                cost.samples = 0;
+            }
+            bucket.exploring = true;
+            return pick(bucket);
+        }
+        return bucket.chosen;
+    }
+
+public:
+    explicit AdaptiveContext(size_t samples_per_strategy = 8, size_t reevaluate_every = 10000)
+        : samples_per_strategy_(std::max<size_t>(samples_per_strategy, 1)), reevaluate_every_(reevaluate_every)
+    {
+    }
+
+    void addStrategy(std::string name, std::unique_ptr<Strategy> &&strategy)
+    {
+        strategies_.emplace_back(std::move(name), std::move(strategy));
+    }
+
+    /**
+     * Throws std::logic_error if no strategy has been added yet, as there is
+     * nothing to pick from.
+     */
+    void doAlgorithm(std::string_view data, char *out)
+    {
+        if (strategies_.empty())
+        {
+            throw std::logic_error("AdaptiveContext: no strategy has been added");
+        }
+        Bucket &bucket = bucketFor(data.size());
+        const size_t index = pick(bucket);
+        const auto start = std::chrono::steady_clock::now();
+        strategies_[index].second->doAlgorithm(data, out);
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        ++bucket.calls;
+        if (bucket.exploring)
+        {
+            StrategyCost &cost = bucket.costs[index];
+            cost.mean_ns += (ns - cost.mean_ns) / static_cast<double>(++cost.samples);
+        }
+    }
+    std::string doAlgorithm(std::string_view data)
+    {
+        std::string result(data.size(), '\0');
+        doAlgorithm(data, result.data());
+        return result;
+    }
+
+    /**
+     * The decision and measured cost of every size bucket seen so far.
+     */
+    std::vector<BucketStats> stats() const
+    {
+        std::vector<BucketStats> stats;
+        for (size_t index = 0; index < buckets_.size(); ++index)
+        {
+            const Bucket &bucket = buckets_[index];
+            if (bucket.calls == 0)
+            {
+                continue;
+            }
+            BucketStats bucket_stats;
+            bucket_stats.min_size = index == 0 ? 0 : size_t{1} << index;
+            bucket_stats.max_size = (size_t{1} << (index + 1)) - 1;
+            bucket_stats.calls = bucket.calls;
+            bucket_stats.chosen = bucket.exploring ? "(sampling)" : strategies_[bucket.chosen].first;
+            bucket_stats.costs = bucket.costs;
+            for (size_t i = 0; i < bucket_stats.costs.size(); ++i)
+            {
+                bucket_stats.costs[i].name = strategies_[i].first;
+            }
+            stats.push_back(std::move(bucket_stats));
+        }
+        return stats;
+    }
+};
+
 /**
  * Client code selects a specific strategy and passes it into  * context. The client
  * must be aware of the differences between strategies in order to make the right choice.
@@ -97,8 +453,111 @@ void clientCode()
     context.doSomeBusinessLogic();
 }
 
+/**
+ * The original kernel, kept only as the baseline for the benchmark.
+ */
+std::string stdSortStrategy(std::string_view data)
+{
+    std::string result(data);
+    std::sort(std::begin(result), std::end(result));
+    return result;
+}
+
+/**
+ * Sorts random bytes of growing length with the original std::sort strategy,
+ * the virtual Context path with the new kernels, and the static path writing
+ * into a reused buffer. Inputs are taken up to kMaxBenchmarkBytes; raise it to
+ * 1 << 30 for the full 1 GB run on a machine with enough memory.
+ */
+constexpr size_t kMaxBenchmarkBytes = size_t{1} << 24;
+
+void benchmarkStrategies()
+{
+    std::mt19937 random(42);
+    std::string input(kMaxBenchmarkBytes, '\0');
+    for (char &c : input)
+    {
+        c = static_cast<char>(random());
+    }
+    std::string buffer(kMaxBenchmarkBytes, '\0');
+    const std::unique_ptr<Strategy> strategy = std::make_unique<ConcreteStrategyA>();
+    const StaticContext<ConcreteStrategyA> context;
+
+    std::cout << "\nbytes  std::sort  virtual  static  (ns/byte)\n";
+    for (size_t length = 8; length <= kMaxBenchmarkBytes; length *= 8)
+    {
+        const size_t rounds = std::max<size_t>(1, (size_t{1} << 24) / length);
+        const std::string_view data(input.data(), length);
+        auto time = [&](auto &&run) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                run();
+            }
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                   (static_cast<double>(rounds) * length);
+        };
+        std::string expected;
+        const double baseline = time([&] { expected = stdSortStrategy(data); });
+        std::string result;
+        const double virtual_path = time([&] { result = strategy->doAlgorithm(data); });
+        const double static_path = time([&] { context.doAlgorithm(data, buffer.data()); });
+        const bool same = expected == result && std::string_view(buffer.data(), length) == expected;
+        std::cout << length << "  " << baseline << "  " << virtual_path << "  " << static_path
+                  << (same ? "" : "  (MISMATCH)") << "\n";
+    }
+}
+
+/**
+ * Feeds requests of very different sizes to an AdaptiveContext and prints
+ * what it decided for each size bucket.
+ */
+void adaptiveClientCode()
+{
+    AdaptiveContext context;
+    context.addStrategy("comparison", std::make_unique<ComparisonSortStrategy>());
+    context.addStrategy("counting", std::make_unique<CountingSortStrategy>());
+    context.addStrategy("hybrid", std::make_unique<ConcreteStrategyA>());
+
+    std::mt19937 random(7);
+    std::string input(1 << 20, '\0');
+    for (char &c : input)
+    {
+        c = static_cast<char>('a' + random() % 26);
+    }
+    std::string buffer(input.size(), '\0');
+    for (size_t call = 0; call < 3000; ++call)
+    {
+        const size_t length = size_t{1} << (random() % 21);
+        context.doAlgorithm(std::string_view(input.data(), length), buffer.data());
+    }
+
+    std::cout << "\nAdaptiveContext decisions (mean ns per call):\n";
+    for (const AdaptiveContext::BucketStats &bucket : context.stats())
+    {
+        std::cout << bucket.min_size << ".." << bucket.max_size << " bytes, " << bucket.calls << " calls -> "
+                  << bucket.chosen << " (";
+        for (const AdaptiveContext::StrategyCost &cost : bucket.costs)
+        {
+            std::cout << " " << cost.name << "=" << static_cast<size_t>(cost.mean_ns);
+        }
+        std::cout << " )\n";
+    }
+}
+
 int main()
 {
     clientCode();
+
+    std::cout << "\nClient: The same strategies without a virtual call or a heap object.\n";
+    const std::array<std::string_view, 2> inputs = {"aecbd", "zyxwvutsrqponmlkjihgfedcba"};
+    std::array<std::string, 2> results = {std::string(inputs[0].size(), ' '), std::string(inputs[1].size(), ' ')};
+    const std::array<char *, 2> outs = {results[0].data(), results[1].data()};
+    VariantContext context(ConcreteStrategyB{});
+    context.doAlgorithm(inputs, outs);
+    std::cout << results[0] << "\n" << results[1] << "\n";
+
+    benchmarkStrategies();
+    adaptiveClientCode();
     return 0;
 }
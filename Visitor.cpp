@@ -1,3 +1,20 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
 /**
  * The Visitor interface declares a set of visit methods corresponding to
  * component classes. The visit method signature allows the visitor to
@@ -8,6 +25,7 @@ class ConcreteComponentB;
 
 class Visitor {
  public:
+  virtual ~Visitor() = default;
   virtual void VisitConcreteComponentA(const ConcreteComponentA *element) const = 0;
   virtual void VisitConcreteComponentB(const ConcreteComponentB *element) const = 0;
 };
@@ -30,12 +48,22 @@ class Component
  */
 class ConcreteComponentA : public Component 
 {
+  int value_;
+
   /**
    * Note that we are calling visitConcreteComponentA, which corresponds to
    * the name of the current class. In this way, we let the visitor know
    * which component class he is working with.
    */
  public:
+  explicit ConcreteComponentA(int value = 0) : value_(value)
+  {
+  }
+  int value() const
+  {
+    return value_;
+  }
+
   void Accept(Visitor *visitor) const override 
   {
     visitor->VisitConcreteComponentA(this);
@@ -53,10 +81,20 @@ class ConcreteComponentA : public Component
 
 class ConcreteComponentB : public Component 
 {
+  int value_;
+
   /**
    * Same here: visitConcreteComponentB => ConcreteComponentB
    */
  public:
+  explicit ConcreteComponentB(int value = 0) : value_(value)
+  {
+  }
+  int value() const
+  {
+    return value_;
+  }
+
   void Accept(Visitor *visitor) const override 
   {
     visitor->VisitConcreteComponentB(this);
@@ -104,6 +142,442 @@ class ConcreteVisitor2 : public Visitor
   }
 };
 
+/**
+ * Components kept by value: either partitioned into one contiguous array per
+ * class (ComponentStore) or as a std::variant. Both are visited without
+ * virtual calls by a batch visitor, i.e. any class with
+ *
+ *   void Visit(const ConcreteComponentA &);
+ *   void Visit(const ConcreteComponentB &);
+ *   void VisitAll(std::span<const ConcreteComponentA>);
+ *   void VisitAll(std::span<const ConcreteComponentB>);
+ *
+ * whose calls the compiler can inline into one loop per array.
+ */
+using AnyComponent = std::variant<ConcreteComponentA, ConcreteComponentB>;
+
+class ComponentStore
+{
+  std::vector<ConcreteComponentA> a_;
+  std::vector<ConcreteComponentB> b_;
+
+ public:
+  void Add(const ConcreteComponentA &component)
+  {
+    a_.push_back(component);
+  }
+  void Add(const ConcreteComponentB &component)
+  {
+    b_.push_back(component);
+  }
+  size_t size() const
+  {
+    return a_.size() + b_.size();
+  }
+  std::span<const ConcreteComponentA> a() const
+  {
+    return a_;
+  }
+  std::span<const ConcreteComponentB> b() const
+  {
+    return b_;
+  }
+
+  /**
+   * Visits every A and then every B, so the order across classes is not
+   * the insertion order.
+   */
+  template <typename BatchVisitor>
+  void Accept(BatchVisitor &visitor) const
+  {
+    visitor.VisitAll(std::span<const ConcreteComponentA>(a_));
+    visitor.VisitAll(std::span<const ConcreteComponentB>(b_));
+  }
+};
+
+template <typename BatchVisitor>
+void VisitAll(std::span<const AnyComponent> components, BatchVisitor &visitor)
+{
+  for (const AnyComponent &component : components)
+  {
+    std::visit([&visitor](const auto &concrete) { visitor.Visit(concrete); }, component);
+  }
+}
+
+/**
+ * Sums A values and doubled B values, as a batch visitor.
+ */
+class SumVisitor
+{
+ public:
+  int64_t total = 0;
+
+  void Visit(const ConcreteComponentA &element)
+  {
+    total += element.value();
+  }
+  void Visit(const ConcreteComponentB &element)
+  {
+    total += 2 * int64_t{element.value()};
+  }
+  void VisitAll(std::span<const ConcreteComponentA> elements)
+  {
+    for (const ConcreteComponentA &element : elements)
+    {
+      Visit(element);
+    }
+  }
+  void VisitAll(std::span<const ConcreteComponentB> elements)
+  {
+    for (const ConcreteComponentB &element : elements)
+    {
+      Visit(element);
+    }
+  }
+};
+
+/**
+ * The same sum through the classic double-dispatch interface.
+ */
+class ClassicSumVisitor : public Visitor
+{
+ public:
+  mutable int64_t total = 0;
+
+  void VisitConcreteComponentA(const ConcreteComponentA *element) const override
+  {
+    total += element->value();
+  }
+  void VisitConcreteComponentB(const ConcreteComponentB *element) const override
+  {
+    total += 2 * int64_t{element->value()};
+  }
+};
+
+/**
+ * A fixed set of threads that run the indices of a ParallelFor between them.
+ * The calling thread takes part too.
+ */
+class VisitorPool
+{
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  const std::function<void(size_t)> *job_ = nullptr;
+  size_t tasks_ = 0;
+  std::atomic<size_t> next_{0};
+  size_t busy_ = 0;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+
+  void RunTasks(const std::function<void(size_t)> &job, size_t tasks)
+  {
+    for (size_t i = next_.fetch_add(1); i < tasks; i = next_.fetch_add(1))
+    {
+      job(i);
+    }
+  }
+
+  void WorkerLoop()
+  {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+      changed_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_)
+      {
+        return;
+      }
+      seen = generation_;
+      // A worker that wakes after ParallelFor returned finds no job.
+      if (job_ == nullptr)
+      {
+        continue;
+      }
+      const std::function<void(size_t)> *job = job_;
+      size_t tasks = tasks_;
+      ++busy_;
+      lock.unlock();
+      RunTasks(*job, tasks);
+      lock.lock();
+      if (--busy_ == 0)
+      {
+        changed_.notify_all();
+      }
+    }
+  }
+
+ public:
+  explicit VisitorPool(size_t threads = std::thread::hardware_concurrency())
+  {
+    for (size_t i = 1; i < std::max<size_t>(threads, 1); ++i)
+    {
+      threads_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+  ~VisitorPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    changed_.notify_all();
+    for (std::thread &thread : threads_)
+    {
+      thread.join();
+    }
+  }
+
+  size_t size() const
+  {
+    return threads_.size() + 1;
+  }
+
+  /**
+   * Runs job(0) .. job(tasks - 1), each exactly once, and returns when all
+   * have finished. Not reentrant.
+   */
+  void ParallelFor(size_t tasks, const std::function<void(size_t)> &job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      tasks_ = tasks;
+      next_.store(0);
+      ++generation_;
+    }
+    changed_.notify_all();
+    RunTasks(job, tasks);
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&] { return busy_ == 0; });
+    // Workers only pick up job_ under the lock, so none can reach it after
+    // this.
+    job_ = nullptr;
+  }
+};
+
+/**
+ * A reduction visitor computes one aggregate over many components. It is
+ * any class with
+ *
+ *   using State = ...;
+ *   State Identity() const;
+ *   void Visit(State &, const ConcreteComponentA &) const;
+ *   void Visit(State &, const ConcreteComponentB &) const;
+ *   void Merge(State &into, const State &from) const;
+ *
+ * ParallelAccept splits the components into fixed-size chunks and reduces
+ * each chunk into its own State on some pool thread. It then merges the
+ * chunk states in chunk order on the caller. The chunking does not depend on
+ * the thread count or the scheduling, so the result is bit-for-bit the same
+ * on one thread or many, even when Merge is not associative (floating point).
+ */
+constexpr size_t kReductionChunk = 16384;
+
+template <typename Reduction>
+typename Reduction::State ParallelAccept(const ComponentStore &store, const Reduction &reduction, VisitorPool &pool)
+{
+  using State = typename Reduction::State;
+  const size_t a_chunks = (store.a().size() + kReductionChunk - 1) / kReductionChunk;
+  const size_t b_chunks = (store.b().size() + kReductionChunk - 1) / kReductionChunk;
+  std::vector<State> partials(a_chunks + b_chunks, reduction.Identity());
+
+  auto reduce = [&reduction](State &state, auto elements)
+  {
+    for (const auto &element : elements)
+    {
+      reduction.Visit(state, element);
+    }
+  };
+  pool.ParallelFor(partials.size(), [&](size_t chunk)
+  {
+    State local = reduction.Identity();
+    if (chunk < a_chunks)
+    {
+      reduce(local, store.a().subspan(chunk * kReductionChunk).first(
+                        std::min(kReductionChunk, store.a().size() - chunk * kReductionChunk)));
+    }
+    else
+    {
+      size_t offset = (chunk - a_chunks) * kReductionChunk;
+      reduce(local, store.b().subspan(offset).first(std::min(kReductionChunk, store.b().size() - offset)));
+    }
+    partials[chunk] = local;
+  });
+
+  State result = reduction.Identity();
+  for (const State &partial : partials)
+  {
+    reduction.Merge(result, partial);
+  }
+  return result;
+}
+
+template <typename Reduction>
+typename Reduction::State ParallelAccept(std::span<const AnyComponent> components, const Reduction &reduction,
+                                         VisitorPool &pool)
+{
+  using State = typename Reduction::State;
+  std::vector<State> partials((components.size() + kReductionChunk - 1) / kReductionChunk, reduction.Identity());
+  pool.ParallelFor(partials.size(), [&](size_t chunk)
+  {
+    State local = reduction.Identity();
+    size_t offset = chunk * kReductionChunk;
+    for (const AnyComponent &component : components.subspan(offset).first(std::min(kReductionChunk, components.size() - offset)))
+    {
+      std::visit([&](const auto &concrete) { reduction.Visit(local, concrete); }, component);
+    }
+    partials[chunk] = local;
+  });
+
+  State result = reduction.Identity();
+  for (const State &partial : partials)
+  {
+    reduction.Merge(result, partial);
+  }
+  return result;
+}
+
+/**
+ * Counts, extremes and a floating-point mean over all components, as a
+ * reduction visitor.
+ */
+class StatisticsVisitor
+{
+ public:
+  struct State
+  {
+    uint64_t count_a = 0;
+    uint64_t count_b = 0;
+    int max_value = 0;
+    double sum = 0;
+
+    bool operator==(const State &) const = default;
+  };
+
+  State Identity() const
+  {
+    return State();
+  }
+  void Visit(State &state, const ConcreteComponentA &element) const
+  {
+    ++state.count_a;
+    state.max_value = std::max(state.max_value, element.value());
+    state.sum += element.value() * 0.1;
+  }
+  void Visit(State &state, const ConcreteComponentB &element) const
+  {
+    ++state.count_b;
+    state.max_value = std::max(state.max_value, element.value());
+    state.sum += element.value() * 0.3;
+  }
+  void Merge(State &into, const State &from) const
+  {
+    into.count_a += from.count_a;
+    into.count_b += from.count_b;
+    into.max_value = std::max(into.max_value, from.max_value);
+    into.sum += from.sum;
+  }
+};
+
+void BenchmarkParallelAccept()
+{
+  constexpr size_t kElements = 1 << 22;
+  std::mt19937 random(7);
+  ComponentStore store;
+  for (size_t i = 0; i < kElements; ++i)
+  {
+    int value = static_cast<int>(random() % 100000);
+    if (random() % 2)
+    {
+      store.Add(ConcreteComponentA(value));
+    }
+    else
+    {
+      store.Add(ConcreteComponentB(value));
+    }
+  }
+
+  StatisticsVisitor statistics;
+  StatisticsVisitor::State reference;
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= std::max<size_t>(cores, 4); threads *= 2)
+  {
+    VisitorPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    StatisticsVisitor::State result = ParallelAccept(store, statistics, pool);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (threads == 1)
+    {
+      reference = result;
+    }
+    bool identical = result == reference;
+    std::cout << threads << " thread(s): " << static_cast<uint64_t>(kElements / seconds) << " elements/s, mean "
+              << result.sum / (result.count_a + result.count_b) << ", max " << result.max_value
+              << (identical ? "" : " (differs from one thread)") << "\n";
+  }
+}
+
+void BenchmarkVisitors()
+{
+  constexpr size_t kElements = 1 << 20;
+  constexpr int kRounds = 20;
+  std::mt19937 random(42);
+  std::vector<std::unique_ptr<Component>> heap;
+  std::vector<AnyComponent> variants;
+  ComponentStore store;
+  for (size_t i = 0; i < kElements; ++i)
+  {
+    int value = static_cast<int>(random() % 1000);
+    if (random() % 2)
+    {
+      heap.push_back(std::make_unique<ConcreteComponentA>(value));
+      variants.emplace_back(ConcreteComponentA(value));
+      store.Add(ConcreteComponentA(value));
+    }
+    else
+    {
+      heap.push_back(std::make_unique<ConcreteComponentB>(value));
+      variants.emplace_back(ConcreteComponentB(value));
+      store.Add(ConcreteComponentB(value));
+    }
+  }
+
+  auto measure = [](const char *name, auto visit)
+  {
+    int64_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; ++round)
+    {
+      total = visit();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << static_cast<uint64_t>(kElements * kRounds / seconds) << " elements/s (sum " << total << ")\n";
+  };
+  measure("Double dispatch:      ", [&]
+  {
+    ClassicSumVisitor visitor;
+    for (const std::unique_ptr<Component> &component : heap)
+    {
+      component->Accept(&visitor);
+    }
+    return visitor.total;
+  });
+  measure("std::variant:         ", [&]
+  {
+    SumVisitor visitor;
+    VisitAll(std::span<const AnyComponent>(variants), visitor);
+    return visitor.total;
+  });
+  measure("Type-partitioned:     ", [&]
+  {
+    SumVisitor visitor;
+    store.Accept(visitor);
+    return visitor.total;
+  });
+}
+
 /**
  * The client code can perform visitor operations on any set of
  * elements without figuring out their specific classes. An accept operation directs
@@ -138,5 +612,10 @@ int main()
   delete visitor1;
   delete visitor2;
 
+  std::cout << "\n";
+  BenchmarkVisitors();
+  std::cout << "\n";
+  BenchmarkParallelAccept();
+
   return 0;
 }
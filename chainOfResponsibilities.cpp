@@ -1,11 +1,46 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 /**
  * The Handler interface declares a method for building a chain of handlers. It
  * Also declares a method for executing the request.
  */
 class Handler {
  public:
+  virtual ~Handler() {
+  }
   virtual Handler *SetNext(Handler *handler) = 0;
-  virtual std::string Handle(std::string request) = 0;
+  virtual Handler *Next() const {
+    return nullptr;
+  }
+  /**
+   * The request is passed as a view, so walking down a long chain never
+   * copies it.
+   */
+  virtual std::string Handle(std::string_view request) = 0;
+  /**
+   * Handles the request at this stage only, without passing it on. An empty
+   * result means this handler is not interested. Batched and pipelined
+   * processing drive the stages through this method.
+   */
+  virtual std::string Process(std::string_view request) = 0;
+  /**
+   * A handler that reacts to exactly one request can name it here, which
+   * allows a compiled chain to find it by hash lookup. An empty key means the
+   * handler decides with an arbitrary predicate.
+   */
+  virtual std::string_view Key() const {
+    return {};
+  }
 };
 
 /**
@@ -30,50 +65,427 @@ class AbstractHandler : public Handler
     // $monkey->setNext($squirrel)->setNext($dog);
     return handler;
   }
-  std::string Handle(std::string request) override {
+  Handler *Next() const override {
+    return this->next_handler_;
+  }
+  std::string Handle(std::string_view request) override {
+    std::string result = this->Process(request);
+    if (!result.empty()) {
+      return result;
+    }
     if (this->next_handler_) {
       return this->next_handler_->Handle(request);
     }
 
     return {};
   }
+  std::string Process(std::string_view /*request*/) override {
+    return {};
+  }
 };
 
 /**
- * All the Specific Handlers either process the request or pass it on
- * to the next handler in the chain.
+ * All the Specific Handlers either process the request or, by returning
+ * nothing from Process, let the base class pass it on to the next handler in
+ * the chain.
  */
 class MonkeyHandler : public AbstractHandler {
  public:
-  std::string Handle(std::string request) override {
-    if (request == "Banana") {
-      return "Monkey: I'll eat the " + request + ".\n";
-    } else {
-      return AbstractHandler::Handle(request);
+  std::string_view Key() const override {
+    return "Banana";
+  }
+  std::string Process(std::string_view /*request*/) override {
+    if (request == this->Key()) {
+      return "Monkey: I'll eat the " + std::string(request) + ".\n";
     }
+    return {};
   }
 };
 class SquirrelHandler : public AbstractHandler {
  public:
-  std::string Handle(std::string request) override {
-    if (request == "Nut") {
-      return "Squirrel: I'll eat the " + request + ".\n";
-    } else {
-      return AbstractHandler::Handle(request);
+  std::string_view Key() const override {
+    return "Nut";
+  }
+  std::string Process(std::string_view /*request*/) override {
+    if (request == this->Key()) {
+      return "Squirrel: I'll eat the " + std::string(request) + ".\n";
     }
+    return {};
   }
 };
 class DogHandler : public AbstractHandler {
  public:
-  std::string Handle(std::string request) override {
-    if (request == "MeatBall") {
-      return "Dog: I'll eat the " + request + ".\n";
-    } else {
-      return AbstractHandler::Handle(request);
+  std::string_view Key() const override {
+    return "MeatBall";
+  }
+  std::string Process(std::string_view /*request*/) override {
+    if (request == this->Key()) {
+      return "Dog: I'll eat the " + std::string(request) + ".\n";
     }
+    return {};
   }
 };
 
+/**
+ * A chain "compiled" into a hash table. All keyed handlers at the front of
+ * the chain are indexed by their key, so a matching request is routed with
+ * one lookup instead of a virtual call per hop. From the first predicate
+ * handler on, order matters again, so a request that misses the table walks
+ * the original chain starting at that handler. The chain must not be
+ * relinked while compiled.
+ */
+class CompiledChain {
+ public:
+  explicit CompiledChain(Handler *head) {
+    Handler *handler = head;
+    for (; handler && !handler->Key().empty(); handler = handler->Next()) {
+      // The first handler with a given key shadows any later one.
+      this->routes_.try_emplace(handler->Key(), handler);
+    }
+    this->fallback_ = handler;
+  }
+
+  std::string Handle(std::string_view request) const {
+    auto it = this->routes_.find(request);
+    if (it != this->routes_.end()) {
+      return it->second->Process(request);
+    }
+    return this->fallback_ ? this->fallback_->Handle(request) : std::string();
+  }
+
+  size_t routes() const {
+    return this->routes_.size();
+  }
+
+ private:
+  std::unordered_map<std::string_view, Handler *> routes_;
+  Handler *fallback_ = nullptr;
+};
+
+/**
+ * A keyed handler with a configurable key, used to build long chains.
+ */
+class FoodHandler : public AbstractHandler {
+ public:
+  explicit FoodHandler(std::string food) : food_(std::move(food)) {
+  }
+  std::string_view Key() const override {
+    return this->food_;
+  }
+  std::string Process(std::string_view /*request*/) override {
+    if (request == this->food_) {
+      return "Animal: I'll eat the " + std::string(request) + ".\n";
+    }
+    return {};
+  }
+
+ private:
+  std::string food_;
+};
+
+/**
+ * A predicate handler: it matches a whole family of requests.
+ */
+class GoatHandler : public AbstractHandler {
+ public:
+  std::string Process(std::string_view /*request*/) override {
+    if (request.find("Grass") != std::string_view::npos) {
+      return "Goat: I'll eat the " + std::string(request) + ".\n";
+    }
+    return {};
+  }
+};
+
+/**
+ * Times requests that match the last handler of chains of growing length,
+ * once through the sequential walk and once through the compiled table.
+ */
+void BenchmarkChainLength() {
+  constexpr size_t kRequests = 200000;
+  std::cout << "\n";
+  for (size_t length : {size_t{1}, size_t{8}, size_t{64}, size_t{256}}) {
+    std::vector<std::unique_ptr<FoodHandler>> chain;
+    for (size_t i = 0; i < length; ++i) {
+      chain.push_back(std::make_unique<FoodHandler>("Food number " + std::to_string(i)));
+      if (i) {
+        chain[i - 1]->SetNext(chain[i].get());
+      }
+    }
+    const std::string request = "Food number " + std::to_string(length - 1);
+    CompiledChain compiled(chain.front().get());
+
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < kRequests; ++r) {
+      sink += chain.front()->Handle(request).size();
+    }
+    const auto walk_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < kRequests; ++r) {
+      sink -= compiled.Handle(request).size();
+    }
+    const auto table_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "chain of " << length << ": sequential " << walk_ns / kRequests << " ns/request, compiled "
+              << table_ns / kRequests << " ns/request" << (sink == 0 ? "" : " (MISMATCH)") << "\n";
+  }
+}
+
+/**
+ * Pushes a whole batch through the chain one stage at a time: every handler
+ * sees all requests still unhandled, answers the ones it wants, and the rest
+ * move on to the next stage. Each handler's code and data stay hot for the
+ * whole batch instead of being revisited once per request. Results are in
+ * request order; empty means nobody handled that request.
+ */
+std::vector<std::string> HandleBatch(Handler *head, std::span<const std::string_view> requests) {
+  std::vector<std::string> results(requests.size());
+  std::vector<size_t> pending(requests.size());
+  for (size_t i = 0; i < pending.size(); ++i) {
+    pending[i] = i;
+  }
+  for (Handler *stage = head; stage && !pending.empty(); stage = stage->Next()) {
+    size_t kept = 0;
+    for (size_t index : pending) {
+      results[index] = stage->Process(requests[index]);
+      if (results[index].empty()) {
+        pending[kept++] = index;
+      }
+    }
+    pending.resize(kept);
+  }
+  return results;
+}
+
+/**
+ * A bounded single-producer single-consumer queue. The producer only writes
+ * `tail_` and the consumer only writes `head_`, so no locks are needed.
+ */
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity) : slots_(capacity + 1) {
+  }
+  bool TryPush(const T &value) {
+    const size_t tail = this->tail_.load(std::memory_order_relaxed);
+    const size_t next = (tail + 1) % this->slots_.size();
+    if (next == this->head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    this->slots_[tail] = value;
+    this->tail_.store(next, std::memory_order_release);
+    return true;
+  }
+  bool TryPop(T &value) {
+    const size_t head = this->head_.load(std::memory_order_relaxed);
+    if (head == this->tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = this->slots_[head];
+    this->head_.store((head + 1) % this->slots_.size(), std::memory_order_release);
+    return true;
+  }
+
+ private:
+  std::vector<T> slots_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+/**
+ * The chain as a multithreaded pipeline: each handler runs on its own thread
+ * and hands what it does not handle to the next stage through a lock-free
+ * queue. A handler is only ever called from its own stage thread. The chain
+ * must not change while the pipeline exists. A stage with nothing to do spins
+ * briefly and then sleeps until something is pushed to it, so an idle
+ * pipeline costs no CPU.
+ */
+class HandlerPipeline {
+  struct Item {
+    size_t index;
+    std::string_view request;
+  };
+
+  // Pushes are counted so a sleeping stage can wait for the count to move.
+  struct Wakeup {
+    alignas(64) std::atomic<uint64_t> pushes{0};
+    std::atomic<bool> sleeping{false};
+  };
+
+  static constexpr int kSpinsBeforeSleep = 64;
+
+ public:
+  explicit HandlerPipeline(Handler *head, size_t queue_capacity = 1024) {
+    for (Handler *stage = head; stage; stage = stage->Next()) {
+      this->stages_.push_back(stage);
+      this->queues_.push_back(std::make_unique<SpscQueue<Item>>(queue_capacity));
+      this->wakeups_.push_back(std::make_unique<Wakeup>());
+    }
+    for (size_t s = 0; s < this->stages_.size(); ++s) {
+      this->threads_.emplace_back([this, s] { this->StageLoop(s); });
+    }
+  }
+  ~HandlerPipeline() {
+    this->stopping_.store(true);
+    for (const std::unique_ptr<Wakeup> &wakeup : this->wakeups_) {
+      wakeup->pushes.fetch_add(1);
+      wakeup->pushes.notify_one();
+    }
+    for (std::thread &thread : this->threads_) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Runs a batch through the pipeline and waits for all of it. Only one
+   * thread may call Run at a time.
+   */
+  std::vector<std::string> Run(std::span<const std::string_view> requests) {
+    std::vector<std::string> results(requests.size());
+    if (this->stages_.empty()) {
+      return results;
+    }
+    this->results_ = results.data();
+    this->done_.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < requests.size(); ++i) {
+      this->Push(0, {i, requests[i]});
+    }
+    this->run_waiting_.store(true);
+    for (size_t done; (done = this->done_.load()) != requests.size();) {
+      this->done_.wait(done);
+    }
+    this->run_waiting_.store(false, std::memory_order_relaxed);
+    return results;
+  }
+
+ private:
+  /**
+   * Waits for room while the next stage is full (it is busy, not idle), then
+   * wakes it if it sleeps.
+   */
+  void Push(size_t s, const Item &item) {
+    while (!this->queues_[s]->TryPush(item)) {
+      std::this_thread::yield();
+    }
+    Wakeup &wakeup = *this->wakeups_[s];
+    wakeup.pushes.fetch_add(1);
+    if (wakeup.sleeping.load()) {
+      wakeup.pushes.notify_one();
+    }
+  }
+
+  bool Pop(size_t s, Item &item) {
+    SpscQueue<Item> &in = *this->queues_[s];
+    for (int spin = 0; spin < kSpinsBeforeSleep; ++spin) {
+      if (in.TryPop(item)) {
+        return true;
+      }
+      if (this->stopping_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+    Wakeup &wakeup = *this->wakeups_[s];
+    for (;;) {
+      wakeup.sleeping.store(true);
+      const uint64_t seen = wakeup.pushes.load();
+      if (in.TryPop(item)) {
+        wakeup.sleeping.store(false, std::memory_order_relaxed);
+        return true;
+      }
+      if (this->stopping_.load()) {
+        wakeup.sleeping.store(false, std::memory_order_relaxed);
+        return false;
+      }
+      wakeup.pushes.wait(seen);
+    }
+  }
+
+  void StageLoop(size_t s) {
+    Handler *stage = this->stages_[s];
+    const bool last = s + 1 == this->queues_.size();
+    Item item;
+    while (this->Pop(s, item)) {
+      std::string result = stage->Process(item.request);
+      if (result.empty() && !last) {
+        this->Push(s + 1, item);
+        continue;
+      }
+      // Every index is written by exactly one stage; done_ publishes it.
+      this->results_[item.index] = std::move(result);
+      this->done_.fetch_add(1);
+      if (this->run_waiting_.load()) {
+        this->done_.notify_one();
+      }
+    }
+  }
+
+  std::vector<Handler *> stages_;
+  std::vector<std::unique_ptr<SpscQueue<Item>>> queues_;
+  std::vector<std::thread> threads_;
+  std::string *results_ = nullptr;
+  std::vector<std::unique_ptr<Wakeup>> wakeups_;
+  std::atomic<size_t> done_{0};
+  std::atomic<bool> run_waiting_{false};
+  std::atomic<bool> stopping_{false};
+};
+
+/**
+ * Compares per-request handling with HandleBatch and the pipeline for batch
+ * sizes 1, 64 and 4096 over an eight-stage chain.
+ */
+void BenchmarkBatches() {
+  constexpr size_t kRequests = 1 << 16;
+  std::vector<std::unique_ptr<FoodHandler>> chain;
+  for (size_t i = 0; i < 8; ++i) {
+    chain.push_back(std::make_unique<FoodHandler>("Food number " + std::to_string(i)));
+    if (i) {
+      chain[i - 1]->SetNext(chain[i].get());
+    }
+  }
+  std::vector<std::string> foods;
+  for (size_t i = 0; i < 10; ++i) {
+    foods.push_back("Food number " + std::to_string(i));
+  }
+  std::vector<std::string_view> requests;
+  for (size_t i = 0; i < kRequests; ++i) {
+    requests.push_back(foods[(i * 7) % foods.size()]);
+  }
+
+  HandlerPipeline pipeline(chain.front().get());
+  std::cout << "\n";
+  for (size_t batch : {size_t{1}, size_t{64}, size_t{4096}}) {
+    size_t single = 0, batched = 0, pipelined = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::string_view request : requests) {
+      single += chain.front()->Handle(request).size();
+    }
+    const double single_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; i += batch) {
+      for (const std::string &result : HandleBatch(chain.front().get(), std::span(requests).subspan(i, std::min(batch, kRequests - i)))) {
+        batched += result.size();
+      }
+    }
+    const double batch_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRequests; i += batch) {
+      for (const std::string &result : pipeline.Run(std::span(requests).subspan(i, std::min(batch, kRequests - i)))) {
+        pipelined += result.size();
+      }
+    }
+    const double pipeline_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "batch " << batch << ": per-request " << static_cast<size_t>(kRequests / single_s)
+              << " req/s, HandleBatch " << static_cast<size_t>(kRequests / batch_s) << " req/s, pipeline "
+              << static_cast<size_t>(kRequests / pipeline_s) << " req/s"
+              << (single == batched && batched == pipelined ? "" : " (MISMATCH)") << "\n";
+  }
+}
+
 /**
  * Normally the client code is adapted to work with a single handler. В
  * In most cases the client doesn't even know that this handler is
@@ -110,10 +522,28 @@ int main() {
   std::cout << "\n";
   std::cout << "Subchain: Squirrel > Dog\n\n";
   ClientCode(*squirrel);
+  std::cout << "\n";
+
+  /**
+   * A compiled chain routes keyed requests with one lookup and only walks
+   * the chain from the first predicate handler onwards.
+   */
+  GoatHandler *goat = new GoatHandler;
+  dog->SetNext(goat);
+  CompiledChain compiled(monkey);
+  std::cout << "Compiled chain: " << compiled.routes() << " keyed routes, then Goat\n\n";
+  for (std::string_view f : {"MeatBall", "Fresh Grass", "Cup of coffee"}) {
+    const std::string result = compiled.Handle(f);
+    std::cout << "  " << (result.empty() ? std::string(f) + " was left untouched.\n" : result);
+  }
 
   delete monkey;
   delete squirrel;
   delete dog;
+  delete goat;
+
+  BenchmarkChainLength();
+  BenchmarkBatches();
 
   return 0;
 }
\ No newline at end of file